@@ -0,0 +1,94 @@
+#include <fmt/format.h>
+
+#include <optional>
+
+#include "ast.hpp"
+#include "ast_printer.hpp"
+
+std::string Ast::to_string(NodeIndex const idx) const {
+  fmt::memory_buffer out;
+  AstPrinter(*this, out).print(idx);
+  return fmt::to_string(out);
+}
+
+void Ast::replace_subtree(
+    NodeIndex const first,
+    NodeIndex const last,
+    Ast const &subtree,
+    std::uint16_t const groups,
+    std::uint32_t const shift_from,
+    std::int64_t const shift) {
+  auto const old_size = std::size_t{last} + 1 - first;
+  auto const new_size = subtree.size();
+
+  // the values of numbers are stored in the order of their nodes, so the old
+  // subtree's are a range of m_numbers too
+  std::size_t removed_numbers = 0;
+  std::optional<std::size_t> number_base;
+  for (auto idx = first; idx <= last; ++idx) {
+    if (m_nodes[idx].kind == NodeKind::NUMBER) {
+      if (!number_base) {
+        number_base = m_nodes[idx].operand;
+      }
+      ++removed_numbers;
+    }
+  }
+  if (!number_base) {
+    number_base = m_numbers.size();
+    for (auto idx = std::size_t{last} + 1; idx < m_nodes.size(); ++idx) {
+      if (m_nodes[idx].kind == NodeKind::NUMBER) {
+        number_base = m_nodes[idx].operand;
+        break;
+      }
+    }
+  }
+
+  auto const nodes_at = [this](std::size_t const idx) {
+    return m_nodes.begin() + static_cast<std::ptrdiff_t>(idx);
+  };
+  m_nodes.erase(nodes_at(first), nodes_at(std::size_t{last} + 1));
+  m_nodes.insert(
+      nodes_at(first), subtree.m_nodes.begin(), subtree.m_nodes.end());
+  auto const numbers_at = [this](std::size_t const idx) {
+    return m_numbers.begin() + static_cast<std::ptrdiff_t>(idx);
+  };
+  m_numbers.erase(
+      numbers_at(*number_base), numbers_at(*number_base + removed_numbers));
+  m_numbers.insert(
+      numbers_at(*number_base),
+      subtree.m_numbers.begin(),
+      subtree.m_numbers.end());
+
+  // the new nodes link to each other and to their numbers from zero
+  for (auto idx = std::size_t{first}; idx < first + new_size; ++idx) {
+    auto &node = m_nodes[idx];
+    if (node.kind == NodeKind::BINARY) {
+      node.operand += first;
+    } else if (node.kind == NodeKind::NUMBER) {
+      node.operand += static_cast<std::uint32_t>(*number_base);
+    }
+  }
+  m_nodes[first + new_size - 1].groups = groups;
+
+  // and the nodes after them move
+  auto const new_root = static_cast<NodeIndex>(first + new_size - 1);
+  auto const node_shift = static_cast<std::int64_t>(new_size)
+      - static_cast<std::int64_t>(old_size);
+  auto const number_shift = static_cast<std::int64_t>(subtree.m_numbers.size())
+      - static_cast<std::int64_t>(removed_numbers);
+  for (auto idx = std::size_t{first} + new_size; idx < m_nodes.size(); ++idx) {
+    auto &node = m_nodes[idx];
+    if (node.kind == NodeKind::BINARY) {
+      if (node.operand == last) {
+        node.operand = new_root;
+      } else if (node.operand > last) {
+        node.operand = static_cast<std::uint32_t>(node.operand + node_shift);
+      }
+    } else if (node.kind == NodeKind::NUMBER) {
+      node.operand = static_cast<std::uint32_t>(node.operand + number_shift);
+    }
+    if (node.offset >= shift_from) {
+      node.offset = static_cast<std::uint32_t>(node.offset + shift);
+    }
+  }
+}
@@ -0,0 +1,216 @@
+#ifndef AST_HPP
+#define AST_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "interner.hpp"
+#include "token_type.hpp"
+
+enum class NodeKind : std::uint8_t {
+  BINARY,
+  UNARY,
+  NUMBER,
+  STRING,
+  BOOL,
+  NIL,
+};
+
+inline constexpr std::size_t num_node_kinds =
+    static_cast<std::size_t>(NodeKind::NIL) + 1;
+
+/// The index of a node in its Ast
+using NodeIndex = std::uint32_t;
+
+/// A node of the AST: a tag, the source offset of its token, and one operand
+/// whose meaning depends on the kind of the node.
+///
+/// Parentheses don't get nodes of their own. Grouping never changes the value
+/// of an expression, so every node just counts the parentheses around it.
+struct Node {
+  NodeKind kind;
+  TokenType oper; // the operator of BINARY and UNARY nodes
+  std::uint16_t groups; // the number of parentheses around the node
+  std::uint32_t offset; // in the source, of the operator or the literal
+  // BINARY: the left operand, NUMBER: the index of its value, STRING: its
+  // symbol, BOOL: its value
+  std::uint32_t operand;
+};
+
+static_assert(sizeof(Node) == 12);
+
+/// A data-oriented AST: all the nodes live in one contiguous array, link to
+/// their children by index, and keep the values of number literals in a side
+/// array.
+///
+/// The parser adds the children of a node before the node itself, so the nodes
+/// are stored in post-order and the root is the last one. That makes the last
+/// operand of a node the node right before it, so only the left operand of a
+/// BINARY node has to be stored. It also means that a pass that needs the
+/// results of the children to process a node, like evaluation, can go over
+/// `nodes()` front to back in a single linear sweep.
+class Ast {
+public:
+  static constexpr std::size_t max_groups =
+      std::numeric_limits<std::uint16_t>::max();
+
+private:
+  std::vector<Node> m_nodes;
+  std::vector<double> m_numbers;
+
+public:
+  Ast() = default;
+  /// An AST made of `nodes`, in post-order, whose NUMBER nodes index
+  /// `numbers`, e.g. loaded from a cache
+  Ast(std::vector<Node> nodes, std::vector<double> numbers)
+      : m_nodes(std::move(nodes)),
+        m_numbers(std::move(numbers)) {}
+
+  /// `right` must be the last node added
+  NodeIndex add_binary(
+      TokenType const oper,
+      std::uint32_t const offset,
+      NodeIndex const left,
+      NodeIndex const right) {
+    assert(right + 1 == m_nodes.size());
+    static_cast<void>(right);
+    return add({NodeKind::BINARY, oper, 0, offset, left});
+  }
+  /// `operand` must be the last node added
+  NodeIndex add_unary(
+      TokenType const oper,
+      std::uint32_t const offset,
+      NodeIndex const operand) {
+    assert(operand + 1 == m_nodes.size());
+    static_cast<void>(operand);
+    return add({NodeKind::UNARY, oper, 0, offset, 0});
+  }
+  NodeIndex add_number(std::uint32_t const offset, double const number) {
+    auto const idx = static_cast<std::uint32_t>(m_numbers.size());
+    m_numbers.push_back(number);
+    return add({NodeKind::NUMBER, TokenType::NUMBER, 0, offset, idx});
+  }
+  NodeIndex add_string(std::uint32_t const offset, Symbol const symbol) {
+    return add({NodeKind::STRING, TokenType::STRING, 0, offset, symbol.id()});
+  }
+  NodeIndex add_bool(std::uint32_t const offset, bool const value) {
+    return add(
+        {NodeKind::BOOL,
+         value ? TokenType::TRUE : TokenType::FALSE,
+         0,
+         offset,
+         value ? 1U : 0U});
+  }
+  NodeIndex add_nil(std::uint32_t const offset) {
+    return add({NodeKind::NIL, TokenType::NIL, 0, offset, 0});
+  }
+  /// Put the node in parentheses. Returns false if it already has the most
+  /// parentheses a node can count.
+  bool add_group(NodeIndex const idx) {
+    if (m_nodes[idx].groups == max_groups) {
+      return false;
+    }
+    ++m_nodes[idx].groups;
+    return true;
+  }
+
+  /// Remove the last node. The values of number literals are added in the
+  /// same order as their nodes, so its value, if any, is the last one.
+  void pop_back() {
+    if (m_nodes.back().kind == NodeKind::NUMBER) {
+      m_numbers.pop_back();
+    }
+    m_nodes.pop_back();
+  }
+
+  /// Replace the subtree made of the nodes [first, last] with the nodes of
+  /// `subtree`, whose root gets `groups` parentheses around it, e.g. after
+  /// parsing an edited part of the source again. The nodes that come after the
+  /// subtree are reused as they are, except that those at offsets past
+  /// `shift_from` move by `shift`.
+  void replace_subtree(
+      NodeIndex first,
+      NodeIndex last,
+      Ast const &subtree,
+      std::uint16_t groups,
+      std::uint32_t shift_from,
+      std::int64_t shift);
+
+  [[nodiscard]] bool empty() const {
+    return m_nodes.empty();
+  }
+  [[nodiscard]] std::size_t size() const {
+    return m_nodes.size();
+  }
+  [[nodiscard]] NodeIndex root() const {
+    return static_cast<NodeIndex>(m_nodes.size() - 1);
+  }
+  [[nodiscard]] Node const &node(NodeIndex const idx) const {
+    return m_nodes[idx];
+  }
+  /// The number of nodes, counting each pair of parentheses as a node too
+  [[nodiscard]] std::size_t node_count() const {
+    auto count = m_nodes.size();
+    for (auto const &node : m_nodes) {
+      count += node.groups;
+    }
+    return count;
+  }
+  /// All the nodes, in post-order
+  [[nodiscard]] std::span<Node const> nodes() const {
+    return m_nodes;
+  }
+  /// The values of the number literals, in the order of their nodes
+  [[nodiscard]] std::span<double const> numbers() const {
+    return m_numbers;
+  }
+
+  /// The left operand of the BINARY node `idx`
+  [[nodiscard]] NodeIndex left(NodeIndex const idx) const {
+    return m_nodes[idx].operand;
+  }
+  /// The right operand of the BINARY node `idx`
+  [[nodiscard]] static NodeIndex right(NodeIndex const idx) {
+    return idx - 1;
+  }
+  /// The operand of the UNARY node `idx`
+  [[nodiscard]] static NodeIndex operand(NodeIndex const idx) {
+    return idx - 1;
+  }
+
+  [[nodiscard]] double number(Node const &node) const {
+    return m_numbers[node.operand];
+  }
+  [[nodiscard]] static Symbol string(Node const &node) {
+    return Symbol(node.operand);
+  }
+  [[nodiscard]] static bool boolean(Node const &node) {
+    return node.operand != 0;
+  }
+
+  /// Print the tree under `idx` in prefix notation, e.g. `(* (- 1) 2)`
+  [[nodiscard]] std::string to_string(NodeIndex idx) const;
+  [[nodiscard]] std::string to_string() const {
+    return to_string(root());
+  }
+
+  /// The bytes allocated for the nodes and the side arrays
+  [[nodiscard]] std::size_t memory_usage() const {
+    return m_nodes.capacity() * sizeof(Node)
+        + m_numbers.capacity() * sizeof(double);
+  }
+
+private:
+  NodeIndex add(Node const &node) {
+    m_nodes.push_back(node);
+    return static_cast<NodeIndex>(m_nodes.size() - 1);
+  }
+};
+
+#endif // AST_HPP
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fmt/format.h>
+#include <span>
+#include <string>
+#include <system_error>
+#include <unistd.h> // getpid
+#include <unordered_map>
+#include <vector>
+
+#include "ast_cache.hpp"
+#include "interner.hpp"
+#include "parser.hpp"
+#include "source_file.hpp"
+
+namespace {
+/// Bumped whenever the layout of an entry changes
+constexpr std::uint32_t format_version = 1;
+constexpr std::array<char, 8> magic{'c', 'p', 'p', 'l', 'o', 'x', 'a', 'c'};
+
+static_assert(
+    sizeof(CPPLOX_VERSION) <= 16,
+    "the version doesn't fit in the header of the cache entries");
+
+/// The start of an entry, followed by the arrays it counts, in this order
+struct Header {
+  std::array<char, 8> magic;
+  std::array<char, 16> version; // CPPLOX_VERSION, padded with NULs
+  std::uint64_t source_hash;
+  std::uint64_t source_size;
+  std::uint64_t checksum; // of the rest of the entry
+  std::uint32_t format;
+  std::uint32_t num_numbers; // doubles
+  std::uint32_t num_nodes; // Nodes
+  std::uint32_t num_lines; // offsets where the lines start
+  std::uint32_t num_strings; // offsets where the strings end
+  std::uint32_t string_bytes; // the strings, one after the other
+};
+
+// the numbers come first, so that they're aligned
+static_assert(sizeof(Header) % alignof(double) == 0);
+static_assert(alignof(Node) <= alignof(double));
+
+constexpr std::array<char, 16> version() {
+  std::array<char, 16> version{};
+  std::ranges::copy(std::string_view(CPPLOX_VERSION), version.begin());
+  return version;
+}
+
+constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+template <typename T>
+T read_value(char const *const bytes) {
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+std::uint64_t hash_round(std::uint64_t const acc, std::uint64_t const input) {
+  return std::rotl(acc + input * prime2, 31) * prime1;
+}
+
+/// XXH64 of `bytes`: four independent lanes of 8 bytes, so that the
+/// multiplications of a 32-byte stripe overlap, which hashes several bytes
+/// per cycle
+std::uint64_t hash_bytes(std::string_view const bytes, std::uint64_t seed) {
+  auto const *ptr = bytes.data();
+  auto const *const end = ptr + bytes.size();
+  std::uint64_t hash{};
+  if (bytes.size() >= 32) {
+    std::array<std::uint64_t, 4> lanes{
+        seed + prime1 + prime2, seed + prime2, seed, seed - prime1};
+    for (; end - ptr >= 32; ptr += 32) {
+      for (std::size_t lane = 0; lane < lanes.size(); ++lane) {
+        lanes[lane] = hash_round(
+            lanes[lane], read_value<std::uint64_t>(ptr + lane * 8));
+      }
+    }
+    hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7)
+        + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+    for (auto const lane : lanes) {
+      hash = (hash ^ hash_round(0, lane)) * prime1 + prime4;
+    }
+  } else {
+    hash = seed + prime5;
+  }
+
+  hash += bytes.size();
+  for (; end - ptr >= 8; ptr += 8) {
+    hash ^= hash_round(0, read_value<std::uint64_t>(ptr));
+    hash = std::rotl(hash, 27) * prime1 + prime4;
+  }
+  if (end - ptr >= 4) {
+    hash ^= read_value<std::uint32_t>(ptr) * prime1;
+    hash = std::rotl(hash, 23) * prime2 + prime3;
+    ptr += 4;
+  }
+  for (; ptr != end; ++ptr) {
+    hash ^= static_cast<unsigned char>(*ptr) * prime5;
+    hash = std::rotl(hash, 11) * prime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= prime2;
+  hash ^= hash >> 29;
+  hash *= prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+template <typename T>
+void write_array(std::string &out, std::span<T const> const array) {
+  if (array.empty()) {
+    return;
+  }
+  auto const offset = out.size();
+  out.resize(offset + array.size_bytes());
+  std::memcpy(out.data() + offset, array.data(), array.size_bytes());
+}
+
+template <typename T>
+std::vector<T> read_array(char const *&bytes, std::size_t const count) {
+  std::vector<T> array(count);
+  if (count > 0) {
+    std::memcpy(array.data(), bytes, count * sizeof(T));
+  }
+  bytes += count * sizeof(T);
+  return array;
+}
+
+/// The script in the entry `bytes`, or nothing if the entry isn't a valid one
+/// for `key`
+std::optional<ParsedScript> read_entry(
+    CacheKey const &key,
+    std::string_view const bytes) {
+  if (bytes.size() < sizeof(Header)) {
+    return std::nullopt;
+  }
+  auto const header = read_value<Header>(bytes.data());
+  if (header.magic != magic || header.format != format_version
+      || header.version != version() || header.source_hash != key.hash
+      || header.source_size != key.size) {
+    return std::nullopt;
+  }
+  auto const size = sizeof(Header) + header.num_numbers * sizeof(double)
+      + header.num_nodes * sizeof(Node)
+      + header.num_lines * sizeof(std::uint32_t)
+      + header.num_strings * sizeof(std::uint32_t) + header.string_bytes;
+  if (bytes.size() != size || header.num_nodes == 0 || header.num_lines == 0
+      || hash_bytes(bytes.substr(sizeof(Header)), 0) != header.checksum) {
+    return std::nullopt;
+  }
+
+  // the checksum only catches accidental corruption, so everything the
+  // evaluator relies on is checked too: the indices, and that the nodes form
+  // one well-formed tree in post-order
+  auto const *cursor = bytes.data() + sizeof(Header);
+  auto numbers = read_array<double>(cursor, header.num_numbers);
+  auto nodes = read_array<Node>(cursor, header.num_nodes);
+  auto line_starts = read_array<std::uint32_t>(cursor, header.num_lines);
+  auto const string_ends =
+      read_array<std::uint32_t>(cursor, header.num_strings);
+  if (line_starts.front() != 0 || !std::ranges::is_sorted(line_starts)
+      || line_starts.back() > key.size || !std::ranges::is_sorted(string_ends)
+      || (!string_ends.empty() && string_ends.back() != header.string_bytes)) {
+    return std::nullopt;
+  }
+
+  std::vector<Symbol> symbols;
+  symbols.reserve(string_ends.size());
+  std::uint32_t string_start = 0;
+  for (auto const string_end : string_ends) {
+    symbols.push_back(Interner::global().intern(
+        {cursor + string_start, string_end - string_start}));
+    string_start = string_end;
+  }
+
+  // the roots of the subtrees seen so far but not yet used as operands, as
+  // the evaluation stack would hold their values
+  std::vector<NodeIndex> roots;
+  for (std::size_t idx = 0; idx < nodes.size(); ++idx) {
+    auto &node = nodes[idx];
+    if (node.offset > key.size) {
+      return std::nullopt;
+    }
+    auto const oper = static_cast<std::size_t>(node.oper);
+    std::size_t operands = 0;
+    bool valid = true;
+    switch (node.kind) {
+    case NodeKind::BINARY: {
+      // the right operand is the last root, and the left one the root before
+      operands = 2;
+      valid = oper < num_token_types
+          && binary_operators[oper].precedence != Precedence::NONE
+          && roots.size() >= 2 && roots[roots.size() - 2] == node.operand;
+      break;
+    }
+    case NodeKind::UNARY: {
+      operands = 1;
+      valid = (node.oper == TokenType::MINUS || node.oper == TokenType::BANG)
+          && !roots.empty();
+      break;
+    }
+    case NodeKind::NUMBER: {
+      valid =
+          node.oper == TokenType::NUMBER && node.operand < numbers.size();
+      break;
+    }
+    case NodeKind::STRING: {
+      valid =
+          node.oper == TokenType::STRING && node.operand < symbols.size();
+      if (valid) {
+        node.operand = symbols[node.operand].id();
+      }
+      break;
+    }
+    case NodeKind::BOOL: {
+      valid = (node.oper == TokenType::TRUE && node.operand == 1)
+          || (node.oper == TokenType::FALSE && node.operand == 0);
+      break;
+    }
+    case NodeKind::NIL: {
+      valid = node.oper == TokenType::NIL;
+      break;
+    }
+    default: {
+      valid = false;
+    }
+    }
+    if (!valid) {
+      return std::nullopt;
+    }
+    roots.resize(roots.size() - operands);
+    roots.push_back(static_cast<NodeIndex>(idx));
+  }
+  if (roots.size() != 1) {
+    return std::nullopt;
+  }
+
+  return ParsedScript{
+      Ast(std::move(nodes), std::move(numbers)),
+      LineTable(std::move(line_starts))};
+}
+} // namespace
+
+CacheKey AstCache::key(std::string_view const source) {
+  // a new version may parse the same source differently
+  auto const seed = hash_bytes(CPPLOX_VERSION, format_version);
+  return {hash_bytes(source, seed), source.size()};
+}
+
+std::optional<ParsedScript> AstCache::load(CacheKey const &key) const {
+  std::optional<SourceFile> entry;
+  try {
+    entry.emplace(path(key).c_str());
+  } catch (std::system_error const &) {
+    // not in the cache
+    return std::nullopt;
+  }
+  return read_entry(key, entry->contents());
+}
+
+void AstCache::store(CacheKey const &key, ParsedScript const &script) const {
+  // the strings are stored by value, numbered in the order of their nodes,
+  // since the symbols are only valid in this process
+  std::vector<Node> nodes(
+      script.ast.nodes().begin(), script.ast.nodes().end());
+  std::unordered_map<std::uint32_t, std::uint32_t> string_numbers;
+  std::vector<std::uint32_t> string_ends;
+  std::string strings;
+  for (auto &node : nodes) {
+    if (node.kind != NodeKind::STRING) {
+      continue;
+    }
+    auto const [it, added] = string_numbers.try_emplace(
+        node.operand, static_cast<std::uint32_t>(string_ends.size()));
+    if (added) {
+      strings.append(Interner::global().view(Ast::string(node)));
+      string_ends.push_back(static_cast<std::uint32_t>(strings.size()));
+    }
+    node.operand = it->second;
+  }
+
+  std::string payload;
+  write_array(payload, script.ast.numbers());
+  write_array(payload, std::span<Node const>(nodes));
+  write_array(payload, script.lines.line_starts());
+  write_array(payload, std::span<std::uint32_t const>(string_ends));
+  payload.append(strings);
+
+  Header const header{
+      magic,
+      version(),
+      key.hash,
+      key.size,
+      hash_bytes(payload, 0),
+      format_version,
+      static_cast<std::uint32_t>(script.ast.numbers().size()),
+      static_cast<std::uint32_t>(nodes.size()),
+      static_cast<std::uint32_t>(script.lines.line_starts().size()),
+      static_cast<std::uint32_t>(string_ends.size()),
+      static_cast<std::uint32_t>(strings.size())};
+
+  // written aside and renamed, so that a concurrent load never sees half an
+  // entry
+  std::filesystem::create_directories(m_directory);
+  auto const file = path(key);
+  auto temp = file;
+  temp += fmt::format(".{}.tmp", getpid());
+  auto *const out = std::fopen(temp.c_str(), "wb");
+  if (out == nullptr) {
+    throw std::system_error(errno, std::generic_category(), temp.native());
+  }
+  auto written = std::fwrite(&header, sizeof(header), 1, out) == 1
+      && std::fwrite(payload.data(), 1, payload.size(), out) == payload.size();
+  written = std::fclose(out) == 0 && written;
+  if (!written) {
+    auto const error = errno;
+    std::error_code ignored;
+    std::filesystem::remove(temp, ignored);
+    throw std::system_error(error, std::generic_category(), temp.native());
+  }
+  std::error_code error;
+  std::filesystem::rename(temp, file, error);
+  if (error) {
+    std::error_code ignored;
+    std::filesystem::remove(temp, ignored);
+    throw std::system_error(error, file.native());
+  }
+}
+
+std::filesystem::path AstCache::path(CacheKey const &key) const {
+  return m_directory / fmt::format("{:016x}-{}.ast", key.hash, key.size);
+}
@@ -0,0 +1,59 @@
+#ifndef AST_CACHE_HPP
+#define AST_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "ast.hpp"
+#include "line_table.hpp"
+
+/// What running a script needs from the front end
+struct ParsedScript {
+  Ast ast;
+  LineTable lines;
+};
+
+/// Identifies a source in the cache: a hash of its bytes and of the version
+/// of cpplox that parsed it, and its size
+struct CacheKey {
+  std::uint64_t hash;
+  std::uint64_t size;
+
+  friend bool operator==(CacheKey const &, CacheKey const &) = default;
+};
+
+/// A directory of parsed scripts, so that running the same script again
+/// doesn't have to scan and parse it again.
+///
+/// Every entry is a compact binary file named after the key of its source,
+/// holding the nodes of the AST, the values of its numbers, the strings it
+/// refers to and the lines of the source. Loading an entry maps it in memory
+/// and copies the arrays out in bulk, which is much cheaper than scanning and
+/// parsing. Entries that are truncated, corrupt, or written by another version
+/// are ignored, and replaced by the next `store()`.
+class AstCache {
+private:
+  std::filesystem::path m_directory;
+
+public:
+  explicit AstCache(std::filesystem::path directory)
+      : m_directory(std::move(directory)) {}
+
+  [[nodiscard]] static CacheKey key(std::string_view source);
+
+  /// The script whose source has `key`, or nothing if it's not in the cache
+  [[nodiscard]] std::optional<ParsedScript> load(CacheKey const &key) const;
+
+  /// Add the script whose source has `key` to the cache, creating the
+  /// directory if needed.
+  /// Throws std::system_error if the entry can't be written.
+  void store(CacheKey const &key, ParsedScript const &script) const;
+
+  /// The file that holds the entry of `key`
+  [[nodiscard]] std::filesystem::path path(CacheKey const &key) const;
+};
+
+#endif // AST_CACHE_HPP
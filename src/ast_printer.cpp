@@ -0,0 +1,52 @@
+#include <iterator>
+
+#include "ast_printer.hpp"
+#include "interner.hpp"
+#include "token_type.hpp"
+
+void AstPrinter::print(NodeIndex const idx) {
+  auto const groups = m_ast.node(idx).groups;
+  for (std::size_t group = 0; group < groups; ++group) {
+    append("(group ");
+  }
+  visit(idx);
+  for (std::size_t group = 0; group < groups; ++group) {
+    m_out.push_back(')');
+  }
+}
+
+void AstPrinter::visit_binary(NodeIndex const idx, Node const &node) {
+  m_out.push_back('(');
+  append(token_type_info(node.oper).spelling);
+  m_out.push_back(' ');
+  print(m_ast.left(idx));
+  m_out.push_back(' ');
+  print(Ast::right(idx));
+  m_out.push_back(')');
+}
+
+void AstPrinter::visit_unary(NodeIndex const idx, Node const &node) {
+  m_out.push_back('(');
+  append(token_type_info(node.oper).spelling);
+  m_out.push_back(' ');
+  print(Ast::operand(idx));
+  m_out.push_back(')');
+}
+
+void AstPrinter::visit_number(NodeIndex /*idx*/, Node const &node) {
+  fmt::format_to(std::back_inserter(m_out), "{}", m_ast.number(node));
+}
+
+void AstPrinter::visit_string(NodeIndex /*idx*/, Node const &node) {
+  m_out.push_back('"');
+  append(Interner::global().view(Ast::string(node)));
+  m_out.push_back('"');
+}
+
+void AstPrinter::visit_bool(NodeIndex /*idx*/, Node const &node) {
+  append(Ast::boolean(node) ? "true" : "false");
+}
+
+void AstPrinter::visit_nil(NodeIndex /*idx*/, Node const & /*node*/) {
+  append("nil");
+}
@@ -0,0 +1,36 @@
+#ifndef AST_PRINTER_HPP
+#define AST_PRINTER_HPP
+
+#include <fmt/format.h>
+
+#include "ast.hpp"
+#include "ast_visitor.hpp"
+
+/// Prints an Ast in prefix notation, e.g. `(* (- 123) (group 45.67))`, in a
+/// single pass that appends to one buffer.
+class AstPrinter : public AstVisitor<AstPrinter> {
+private:
+  fmt::memory_buffer &m_out;
+
+public:
+  AstPrinter(Ast const &ast, fmt::memory_buffer &out)
+      : AstVisitor(ast),
+        m_out(out) {}
+
+  /// Print the tree under `idx`, along with the parentheses around it
+  void print(NodeIndex idx);
+
+  void visit_binary(NodeIndex idx, Node const &node);
+  void visit_unary(NodeIndex idx, Node const &node);
+  void visit_number(NodeIndex idx, Node const &node);
+  void visit_string(NodeIndex idx, Node const &node);
+  void visit_bool(NodeIndex idx, Node const &node);
+  void visit_nil(NodeIndex idx, Node const &node);
+
+private:
+  void append(std::string_view str) {
+    m_out.append(str);
+  }
+};
+
+#endif // AST_PRINTER_HPP
@@ -0,0 +1,45 @@
+#ifndef AST_VISITOR_HPP
+#define AST_VISITOR_HPP
+
+#include "ast.hpp"
+
+/// The base of the passes over an Ast, with static dispatch on the kind of the
+/// nodes: `visit()` calls the `visit_<kind>(NodeIndex, Node const &)` member
+/// function of `Derived` that matches the node, without any virtual calls.
+/// Derived classes recurse into the children by calling `visit()` on them.
+template <typename Derived, typename Result = void>
+class AstVisitor {
+protected:
+  Ast const &m_ast;
+
+public:
+  explicit AstVisitor(Ast const &ast) : m_ast(ast) {}
+
+  Result visit(NodeIndex const idx) {
+    auto &self = static_cast<Derived &>(*this);
+    auto const &node = m_ast.node(idx);
+    switch (node.kind) {
+    case NodeKind::BINARY: {
+      return self.visit_binary(idx, node);
+    }
+    case NodeKind::UNARY: {
+      return self.visit_unary(idx, node);
+    }
+    case NodeKind::NUMBER: {
+      return self.visit_number(idx, node);
+    }
+    case NodeKind::STRING: {
+      return self.visit_string(idx, node);
+    }
+    case NodeKind::BOOL: {
+      return self.visit_bool(idx, node);
+    }
+    case NodeKind::NIL: {
+      return self.visit_nil(idx, node);
+    }
+    }
+    __builtin_unreachable();
+  }
+};
+
+#endif // AST_VISITOR_HPP
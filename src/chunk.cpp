@@ -0,0 +1,92 @@
+#include <array>
+#include <fmt/format.h>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+#include "chunk.hpp"
+
+namespace {
+constexpr std::array<std::string_view, num_opcodes> opcode_names{
+    "CONSTANT",
+    "CONSTANT_LONG",
+    "NIL",
+    "TRUE",
+    "FALSE",
+    "EQUAL",
+    "NOT_EQUAL",
+    "GREATER",
+    "GREATER_EQUAL",
+    "LESS",
+    "LESS_EQUAL",
+    "ADD",
+    "SUBTRACT",
+    "MULTIPLY",
+    "DIVIDE",
+    "NOT",
+    "NEGATE",
+    "RETURN"};
+} // namespace
+
+void Chunk::emit_constant(Value const value, std::size_t const line) {
+  auto [it, inserted] = m_constant_indices.try_emplace(
+      value.bits(), static_cast<std::uint32_t>(m_constants.size()));
+  if (inserted) {
+    if (m_constants.size() == max_constants) {
+      m_constant_indices.erase(it);
+      throw std::length_error("Too many constants in one chunk.");
+    }
+    m_constants.push_back(value);
+  }
+
+  auto const index = it->second;
+  if (index <= 0xff) {
+    emit(OpCode::CONSTANT, line);
+    m_code.push_back(static_cast<std::uint8_t>(index));
+  } else {
+    emit(OpCode::CONSTANT_LONG, line);
+    m_code.push_back(static_cast<std::uint8_t>(index));
+    m_code.push_back(static_cast<std::uint8_t>(index >> 8U));
+    m_code.push_back(static_cast<std::uint8_t>(index >> 16U));
+  }
+}
+
+std::string disassemble(Chunk const &chunk) {
+  fmt::memory_buffer out;
+  auto const &code = chunk.code();
+  std::size_t previous_line = 0;
+  for (std::size_t offset = 0; offset < code.size();) {
+    fmt::format_to(std::back_inserter(out), "{:04} ", offset);
+    auto const line = chunk.line(offset);
+    if (line == previous_line) {
+      fmt::format_to(std::back_inserter(out), "   | ");
+    } else {
+      fmt::format_to(std::back_inserter(out), "{:4} ", line);
+    }
+    previous_line = line;
+
+    auto const op = static_cast<OpCode>(code[offset]);
+    auto const name = opcode_names[code[offset]];
+    ++offset;
+    if (op == OpCode::CONSTANT || op == OpCode::CONSTANT_LONG) {
+      std::size_t index = code[offset++];
+      if (op == OpCode::CONSTANT_LONG) {
+        index |= std::size_t{code[offset++]} << 8U;
+        index |= std::size_t{code[offset++]} << 16U;
+      }
+      auto const &value = chunk.constants()[index];
+      auto const quote = value.is_string() ? '"' : '\'';
+      fmt::format_to(
+          std::back_inserter(out),
+          "{:<16} {:4} {}{}{}\n",
+          name,
+          index,
+          quote,
+          value.to_string(),
+          quote);
+    } else {
+      fmt::format_to(std::back_inserter(out), "{}\n", name);
+    }
+  }
+  return fmt::to_string(out);
+}
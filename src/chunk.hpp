@@ -0,0 +1,113 @@
+#ifndef CHUNK_HPP
+#define CHUNK_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "value.hpp"
+
+/// The instructions of the bytecode VM. Each is one byte, followed by the
+/// operands listed here.
+enum class OpCode : std::uint8_t {
+  CONSTANT, // 1-byte index in the constant pool
+  CONSTANT_LONG, // 3-byte little-endian index in the constant pool
+  NIL,
+  TRUE,
+  FALSE,
+  EQUAL,
+  NOT_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  LESS,
+  LESS_EQUAL,
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE,
+  NOT,
+  NEGATE,
+  RETURN,
+};
+
+inline constexpr std::size_t num_opcodes =
+    static_cast<std::size_t>(OpCode::RETURN) + 1;
+
+/// A compiled expression: its bytecode, the constants it loads, and the source
+/// line of every instruction, to report runtime errors.
+///
+/// The lines are run-length encoded, since consecutive instructions mostly come
+/// from the same line: every run records the offset of its first instruction.
+class Chunk {
+public:
+  static constexpr std::size_t max_constants = std::size_t{1} << 24U;
+
+private:
+  struct LineRun {
+    std::uint32_t code_offset;
+    std::uint32_t line;
+  };
+
+  std::vector<std::uint8_t> m_code;
+  std::vector<Value> m_constants;
+  std::vector<LineRun> m_lines;
+  std::unordered_map<std::uint64_t, std::uint32_t> m_constant_indices;
+  std::size_t m_max_stack{};
+
+public:
+  /// Append an instruction that comes from `line`
+  void emit(OpCode const op, std::size_t const line) {
+    if (m_lines.empty() || m_lines.back().line != line) {
+      m_lines.push_back(
+          {static_cast<std::uint32_t>(m_code.size()),
+           static_cast<std::uint32_t>(line)});
+    }
+    m_code.push_back(static_cast<std::uint8_t>(op));
+  }
+
+  /// Append an instruction that loads `value`. Equal constants share the same
+  /// slot of the pool.
+  /// Throws std::length_error if the pool already holds `max_constants`.
+  void emit_constant(Value value, std::size_t line);
+
+  /// Reserve room for `num_bytes` of bytecode
+  void reserve(std::size_t const num_bytes) {
+    m_code.reserve(num_bytes);
+  }
+
+  /// Record the deepest the VM stack gets when running the chunk, so that the
+  /// VM can allocate it up front and never check for overflows
+  void set_max_stack(std::size_t const max_stack) {
+    m_max_stack = max_stack;
+  }
+
+  [[nodiscard]] std::vector<std::uint8_t> const &code() const {
+    return m_code;
+  }
+  [[nodiscard]] std::vector<Value> const &constants() const {
+    return m_constants;
+  }
+  [[nodiscard]] std::size_t max_stack() const {
+    return m_max_stack;
+  }
+
+  /// The line of the instruction at `code_offset`
+  [[nodiscard]] std::size_t line(std::size_t const code_offset) const {
+    auto const it = std::ranges::upper_bound(
+        m_lines,
+        code_offset,
+        {},
+        [](LineRun const &run) { return std::size_t{run.code_offset}; });
+    return std::prev(it)->line;
+  }
+};
+
+/// A listing of the instructions of `chunk`, one per line, e.g.
+/// `0000    1 CONSTANT         0 '1.5'`
+[[nodiscard]] std::string disassemble(Chunk const &chunk);
+
+#endif // CHUNK_HPP
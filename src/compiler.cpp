@@ -0,0 +1,107 @@
+#include <algorithm>
+
+#include "compiler.hpp"
+
+namespace {
+OpCode binary_opcode(TokenType const oper) {
+  switch (oper) {
+  case TokenType::EQUAL_EQUAL: {
+    return OpCode::EQUAL;
+  }
+  case TokenType::BANG_EQUAL: {
+    return OpCode::NOT_EQUAL;
+  }
+  case TokenType::GREATER: {
+    return OpCode::GREATER;
+  }
+  case TokenType::GREATER_EQUAL: {
+    return OpCode::GREATER_EQUAL;
+  }
+  case TokenType::LESS: {
+    return OpCode::LESS;
+  }
+  case TokenType::LESS_EQUAL: {
+    return OpCode::LESS_EQUAL;
+  }
+  case TokenType::PLUS: {
+    return OpCode::ADD;
+  }
+  case TokenType::MINUS: {
+    return OpCode::SUBTRACT;
+  }
+  case TokenType::STAR: {
+    return OpCode::MULTIPLY;
+  }
+  case TokenType::SLASH: {
+    return OpCode::DIVIDE;
+  }
+  default: {
+    __builtin_unreachable();
+  }
+  }
+}
+} // namespace
+
+Chunk compile(Ast const &ast, LineTable const &lines) {
+  Chunk chunk;
+  // most nodes take one byte, and constants two
+  chunk.reserve(2 * ast.size() + 1);
+  std::size_t depth = 0;
+  std::size_t max_depth = 0;
+
+  // consecutive nodes are mostly on the same line, so only search the line
+  // table when a node is outside the range of the last line found
+  std::size_t line = 1;
+  std::uint32_t line_start = 0;
+  std::uint32_t line_end = 0;
+
+  for (auto const &node : ast.nodes()) {
+    if (node.offset < line_start || node.offset >= line_end) {
+      line = lines.line(node.offset);
+      line_start = lines.line_start(line);
+      line_end = lines.line_end(line);
+    }
+    switch (node.kind) {
+    case NodeKind::BINARY: {
+      chunk.emit(binary_opcode(node.oper), line);
+      --depth;
+      break;
+    }
+    case NodeKind::UNARY: {
+      chunk.emit(
+          node.oper == TokenType::BANG ? OpCode::NOT : OpCode::NEGATE, line);
+      break;
+    }
+    case NodeKind::NUMBER: {
+      chunk.emit_constant(Value(ast.number(node)), line);
+      max_depth = std::max(max_depth, ++depth);
+      break;
+    }
+    case NodeKind::STRING: {
+      chunk.emit_constant(Value(Ast::string(node)), line);
+      max_depth = std::max(max_depth, ++depth);
+      break;
+    }
+    case NodeKind::BOOL: {
+      chunk.emit(Ast::boolean(node) ? OpCode::TRUE : OpCode::FALSE, line);
+      max_depth = std::max(max_depth, ++depth);
+      break;
+    }
+    case NodeKind::NIL: {
+      chunk.emit(OpCode::NIL, line);
+      max_depth = std::max(max_depth, ++depth);
+      break;
+    }
+    }
+  }
+
+  if (ast.empty()) {
+    chunk.emit(OpCode::NIL, 1);
+    chunk.emit(OpCode::RETURN, 1);
+    chunk.set_max_stack(1);
+    return chunk;
+  }
+  chunk.emit(OpCode::RETURN, lines.line(ast.node(ast.root()).offset));
+  chunk.set_max_stack(max_depth);
+  return chunk;
+}
@@ -0,0 +1,18 @@
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+#include "ast.hpp"
+#include "chunk.hpp"
+#include "line_table.hpp"
+
+/// Compile `ast` to bytecode for the stack VM, taking the line of every
+/// instruction from `lines`. The chunk ends with a RETURN of the value of the
+/// expression.
+/// Throws std::length_error if the expression has more than
+/// `Chunk::max_constants` distinct constants.
+///
+/// The nodes of an Ast are stored in post-order, which is the order a stack
+/// machine needs its instructions in, so compiling is a single linear sweep.
+[[nodiscard]] Chunk compile(Ast const &ast, LineTable const &lines);
+
+#endif // COMPILER_HPP
@@ -0,0 +1,178 @@
+#include <string>
+#include <vector>
+
+#include "constant_folder.hpp"
+#include "interner.hpp"
+
+namespace {
+[[nodiscard]] bool is_literal(Node const &node) {
+  return node.kind != NodeKind::BINARY && node.kind != NodeKind::UNARY;
+}
+
+/// Nil and false are falsey, everything else is truthy
+[[nodiscard]] bool is_truthy(Node const &node) {
+  return !(node.kind == NodeKind::NIL
+           || (node.kind == NodeKind::BOOL && !Ast::boolean(node)));
+}
+
+/// Fold the operator of `node` over the literals `left` and `right`, which are
+/// the last two nodes of `out`. Returns false if the operation can't be folded.
+bool fold_binary(
+    Ast &out,
+    Node const &node,
+    Node const &left,
+    Node const &right) {
+  auto const offset = node.offset;
+  auto const replace = [&out](auto add) {
+    out.pop_back();
+    out.pop_back();
+    add();
+    return true;
+  };
+
+  if (node.oper == TokenType::EQUAL_EQUAL
+      || node.oper == TokenType::BANG_EQUAL) {
+    bool equal = false;
+    if (left.kind == right.kind) {
+      switch (left.kind) {
+      case NodeKind::NUMBER: {
+        equal = out.number(left) == out.number(right);
+        break;
+      }
+      case NodeKind::STRING: {
+        equal = Ast::string(left) == Ast::string(right);
+        break;
+      }
+      case NodeKind::BOOL: {
+        equal = Ast::boolean(left) == Ast::boolean(right);
+        break;
+      }
+      default: {
+        equal = true;
+        break;
+      }
+      }
+    }
+    auto const value = equal == (node.oper == TokenType::EQUAL_EQUAL);
+    return replace([&] { out.add_bool(offset, value); });
+  }
+
+  if (left.kind == NodeKind::STRING && right.kind == NodeKind::STRING) {
+    if (node.oper != TokenType::PLUS) {
+      return false;
+    }
+    auto &interner = Interner::global();
+    auto concatenation = std::string(interner.view(Ast::string(left)));
+    concatenation.append(interner.view(Ast::string(right)));
+    auto const symbol = interner.intern(concatenation);
+    return replace([&] { out.add_string(offset, symbol); });
+  }
+
+  if (left.kind != NodeKind::NUMBER || right.kind != NodeKind::NUMBER) {
+    return false;
+  }
+  auto const lhs = out.number(left);
+  auto const rhs = out.number(right);
+  switch (node.oper) {
+  case TokenType::PLUS: {
+    return replace([&] { out.add_number(offset, lhs + rhs); });
+  }
+  case TokenType::MINUS: {
+    return replace([&] { out.add_number(offset, lhs - rhs); });
+  }
+  case TokenType::STAR: {
+    return replace([&] { out.add_number(offset, lhs * rhs); });
+  }
+  case TokenType::SLASH: {
+    return replace([&] { out.add_number(offset, lhs / rhs); });
+  }
+  case TokenType::LESS: {
+    return replace([&] { out.add_bool(offset, lhs < rhs); });
+  }
+  case TokenType::LESS_EQUAL: {
+    return replace([&] { out.add_bool(offset, lhs <= rhs); });
+  }
+  case TokenType::GREATER: {
+    return replace([&] { out.add_bool(offset, lhs > rhs); });
+  }
+  case TokenType::GREATER_EQUAL: {
+    return replace([&] { out.add_bool(offset, lhs >= rhs); });
+  }
+  default: {
+    return false;
+  }
+  }
+}
+
+/// Fold the operator of `node` over the literal `operand`, which is the last
+/// node of `out`. Returns false if the operation can't be folded.
+bool fold_unary(Ast &out, Node const &node, Node const &operand) {
+  if (node.oper == TokenType::BANG) {
+    auto const value = !is_truthy(operand);
+    out.pop_back();
+    out.add_bool(node.offset, value);
+    return true;
+  }
+  if (node.oper == TokenType::MINUS && operand.kind == NodeKind::NUMBER) {
+    auto const value = -out.number(operand);
+    out.pop_back();
+    out.add_number(node.offset, value);
+    return true;
+  }
+  return false;
+}
+} // namespace
+
+/// The nodes are copied in a single post-order sweep. The output is built like
+/// a stack: when an operator is reached its operands are the last nodes of the
+/// output, so if they are literals they can be popped and replaced by the
+/// literal of the result.
+Ast fold_constants(Ast const &ast) {
+  Ast out;
+  // the index in `out` of the result of every node of `ast`
+  std::vector<NodeIndex> results(ast.size());
+
+  for (NodeIndex idx = 0; idx < ast.size(); ++idx) {
+    auto const &node = ast.node(idx);
+    switch (node.kind) {
+    case NodeKind::BINARY: {
+      auto const left = results[ast.left(idx)];
+      auto const right = results[Ast::right(idx)];
+      // copies, since folding pops them off the output
+      auto const left_node = out.node(left);
+      auto const right_node = out.node(right);
+      if (!is_literal(left_node) || !is_literal(right_node)
+          || !fold_binary(out, node, left_node, right_node)) {
+        out.add_binary(node.oper, node.offset, left, right);
+      }
+      break;
+    }
+    case NodeKind::UNARY: {
+      auto const operand = results[Ast::operand(idx)];
+      auto const operand_node = out.node(operand);
+      if (!is_literal(operand_node) || !fold_unary(out, node, operand_node)) {
+        out.add_unary(node.oper, node.offset, operand);
+      }
+      break;
+    }
+    case NodeKind::NUMBER: {
+      out.add_number(node.offset, ast.number(node));
+      break;
+    }
+    case NodeKind::STRING: {
+      out.add_string(node.offset, Ast::string(node));
+      break;
+    }
+    case NodeKind::BOOL: {
+      out.add_bool(node.offset, Ast::boolean(node));
+      break;
+    }
+    case NodeKind::NIL: {
+      out.add_nil(node.offset);
+      break;
+    }
+    }
+    results[idx] = out.root();
+  }
+  return out;
+}
@@ -0,0 +1,15 @@
+#ifndef CONSTANT_FOLDER_HPP
+#define CONSTANT_FOLDER_HPP
+
+#include "ast.hpp"
+
+/// Return a copy of `ast` where every operation on literals has been replaced
+/// by a literal of its result: arithmetic and comparisons of numbers, string
+/// concatenation, equality, and logical negation. Numbers follow IEEE-754
+/// double arithmetic, so e.g. `1 / 0` folds to infinity and `0 / 0` to NaN.
+/// Operations that would fail at runtime, like `-"a"`, are kept as they are.
+///
+/// Parentheses never change the value of an expression, so they are dropped.
+[[nodiscard]] Ast fold_constants(Ast const &ast);
+
+#endif // CONSTANT_FOLDER_HPP
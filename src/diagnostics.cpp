@@ -0,0 +1,144 @@
+#include <iterator>
+
+#include "diagnostics.hpp"
+
+namespace {
+/// Indexed by Severity
+constexpr std::array<std::string_view, 1> severity_names{"error"};
+} // namespace
+
+void format_json_string(fmt::memory_buffer &out, std::string_view const text) {
+  out.push_back('"');
+  for (auto const ch : text) {
+    switch (ch) {
+    case '"': {
+      out.append(std::string_view("\\\""));
+      break;
+    }
+    case '\\': {
+      out.append(std::string_view("\\\\"));
+      break;
+    }
+    case '\n': {
+      out.append(std::string_view("\\n"));
+      break;
+    }
+    case '\t': {
+      out.append(std::string_view("\\t"));
+      break;
+    }
+    case '\r': {
+      out.append(std::string_view("\\r"));
+      break;
+    }
+    default: {
+      if (static_cast<unsigned char>(ch) < 0x20) {
+        fmt::format_to(
+            std::back_inserter(out),
+            "\\u{:04x}",
+            static_cast<unsigned>(ch));
+      } else {
+        out.push_back(ch);
+      }
+    }
+    }
+  }
+  out.push_back('"');
+}
+
+void DiagnosticSink::report(Diagnostic const &diagnostic) {
+  if (m_autoflush == nullptr) {
+    m_diagnostics.push_back(diagnostic);
+    return;
+  }
+  fmt::memory_buffer out;
+  format(out, diagnostic, DiagnosticFormat::TEXT, {});
+  std::fwrite(out.data(), 1, out.size(), m_autoflush);
+}
+
+void DiagnosticSink::format(
+    fmt::memory_buffer &out,
+    DiagnosticFormat const format,
+    std::string_view const path) const {
+  for (auto const &diagnostic : m_diagnostics) {
+    this->format(out, diagnostic, format, path);
+  }
+}
+
+void DiagnosticSink::flush(
+    std::FILE *const out,
+    DiagnosticFormat const format) {
+  fmt::memory_buffer text;
+  this->format(text, format);
+  std::fwrite(text.data(), 1, text.size(), out);
+  std::fflush(out);
+  m_diagnostics.clear();
+}
+
+void DiagnosticSink::format(
+    fmt::memory_buffer &out,
+    Diagnostic const &diagnostic,
+    DiagnosticFormat const format,
+    std::string_view const path) const {
+  auto const &info =
+      diagnostic_codes[static_cast<std::size_t>(diagnostic.code)];
+  auto const text = m_source.substr(diagnostic.offset, diagnostic.length);
+  auto const inserter = std::back_inserter(out);
+
+  if (format == DiagnosticFormat::JSON_LINES) {
+    out.push_back('{');
+    if (!path.empty()) {
+      out.append(std::string_view(R"("file":)"));
+      format_json_string(out, path);
+      out.push_back(',');
+    }
+    fmt::format_to(
+        inserter,
+        R"("severity":"{}","code":"{}","message":)",
+        severity_names[static_cast<std::size_t>(diagnostic.severity)],
+        info.name);
+    format_json_string(out, info.message);
+    fmt::format_to(
+        inserter,
+        R"(,"line":{},"column":{},"offset":{},"length":{},)",
+        diagnostic.line,
+        diagnostic.column,
+        diagnostic.offset,
+        diagnostic.length);
+    if (diagnostic.token) {
+      fmt::format_to(
+          inserter,
+          R"("token":"{}",)",
+          token_types[static_cast<std::size_t>(*diagnostic.token)].name);
+    }
+    out.append(std::string_view(R"("text":)"));
+    format_json_string(out, text);
+    out.append(std::string_view("}\n"));
+    return;
+  }
+
+  if (!path.empty()) {
+    fmt::format_to(inserter, "{}: ", path);
+  }
+  if (!diagnostic.token) {
+    fmt::format_to(
+        inserter,
+        "Error at line: {}: {}: {}\n",
+        diagnostic.line,
+        info.message,
+        text);
+  } else if (*diagnostic.token == TokenType::END_OF_FILE) {
+    fmt::format_to(
+        inserter,
+        "Error at line: {}: {}:  at end\n",
+        diagnostic.line,
+        info.message);
+  } else {
+    fmt::format_to(
+        inserter,
+        "Error at line: {}: {}:  at \"{}\"\n",
+        diagnostic.line,
+        info.message,
+        text);
+  }
+}
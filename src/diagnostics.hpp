@@ -0,0 +1,153 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fmt/format.h>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "line_table.hpp"
+#include "token_type.hpp"
+
+enum class Severity : std::uint8_t {
+  ERROR,
+};
+
+enum class DiagnosticCode : std::uint8_t {
+  // scanner
+  UNEXPECTED_CHARACTER,
+  UNTERMINATED_STRING,
+  // parser
+  EXPECTED_EXPRESSION,
+  EXPECTED_RIGHT_PAREN,
+  EXPECTED_END_OF_EXPRESSION,
+  TOO_MANY_PARENTHESES,
+};
+
+struct DiagnosticInfo {
+  DiagnosticCode code;
+  std::string_view name; // stable, for tools
+  std::string_view message; // for humans
+};
+
+/// The names and the messages of the diagnostics, indexed by DiagnosticCode
+inline constexpr std::array<DiagnosticInfo, 6> diagnostic_codes{{
+    {DiagnosticCode::UNEXPECTED_CHARACTER,
+     "unexpected-character",
+     "Unexpected character"},
+    {DiagnosticCode::UNTERMINATED_STRING,
+     "unterminated-string",
+     "Unterminated string"},
+    {DiagnosticCode::EXPECTED_EXPRESSION,
+     "expected-expression",
+     "Expected expression"},
+    {DiagnosticCode::EXPECTED_RIGHT_PAREN,
+     "expected-right-paren",
+     "Exprected ')' after expression"},
+    {DiagnosticCode::EXPECTED_END_OF_EXPRESSION,
+     "expected-end-of-expression",
+     "Expected end of expression"},
+    {DiagnosticCode::TOO_MANY_PARENTHESES,
+     "too-many-parentheses",
+     "Too many parentheses"},
+}};
+
+[[nodiscard]] constexpr std::string_view message(DiagnosticCode const code) {
+  return diagnostic_codes[static_cast<std::size_t>(code)].message;
+}
+
+/// Append `text` to `out` as a JSON string, quoted and escaped
+void format_json_string(fmt::memory_buffer &out, std::string_view text);
+
+/// A diagnostic about a part of the source, as a compact record. The text of
+/// the diagnostic is only put together when it's written out.
+struct Diagnostic {
+  std::uint32_t offset; // in the source, of the text it's about
+  std::uint32_t length; // of that text
+  std::uint32_t line;
+  std::uint32_t column;
+  Severity severity;
+  DiagnosticCode code;
+  std::optional<TokenType> token; // the token it's at, for syntax errors
+};
+
+static_assert(sizeof(Diagnostic) == 20);
+
+enum class DiagnosticFormat : std::uint8_t {
+  TEXT, // one message per line, for humans
+  JSON_LINES, // one JSON object per line, for tools
+};
+
+/// Collects the diagnostics of one run over a source, e.g. from the Scanner
+/// and the Parser, and writes them out in one go when flushed.
+///
+/// A sink can also write every diagnostic out as text as soon as it's
+/// reported, for interactive use.
+class DiagnosticSink {
+private:
+  std::string_view m_source;
+  std::vector<Diagnostic> m_diagnostics;
+  std::FILE *m_autoflush{};
+
+public:
+  /// Diagnostics about `source`, which must outlive the sink. With
+  /// `autoflush`, they're written there right away instead of being kept.
+  explicit DiagnosticSink(
+      std::string_view const source,
+      std::FILE *const autoflush = nullptr)
+      : m_source(source),
+        m_autoflush(autoflush) {}
+
+  void report(Diagnostic const &diagnostic);
+
+  /// Report an error about the `length` bytes at `offset`, whose line and
+  /// column are looked up in `lines`
+  void report(
+      DiagnosticCode const code,
+      LineTable const &lines,
+      std::uint32_t const offset,
+      std::uint32_t const length,
+      std::optional<TokenType> const token = std::nullopt) {
+    report(
+        {offset,
+         length,
+         static_cast<std::uint32_t>(lines.line(offset)),
+         static_cast<std::uint32_t>(lines.column(offset)),
+         Severity::ERROR,
+         code,
+         token});
+  }
+
+  [[nodiscard]] std::span<Diagnostic const> diagnostics() const {
+    return m_diagnostics;
+  }
+  [[nodiscard]] bool empty() const {
+    return m_diagnostics.empty();
+  }
+
+  /// Append the diagnostics to `out`, each line starting with `path` if it's
+  /// not empty
+  void format(
+      fmt::memory_buffer &out,
+      DiagnosticFormat format,
+      std::string_view path = {}) const;
+
+  /// Write the diagnostics to `out` with a single write, and forget them
+  void flush(
+      std::FILE *out,
+      DiagnosticFormat format = DiagnosticFormat::TEXT);
+
+private:
+  void format(
+      fmt::memory_buffer &out,
+      Diagnostic const &diagnostic,
+      DiagnosticFormat format,
+      std::string_view path) const;
+};
+
+#endif // DIAGNOSTICS_HPP
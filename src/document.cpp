@@ -0,0 +1,278 @@
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include "document.hpp"
+
+Document::Document(std::string source)
+    : m_source(std::move(source)),
+      m_tokens(m_source) {
+  scan_all();
+  parse_all();
+}
+
+EditStats Document::edit(TextEdit const &edit) {
+  if (edit.offset > m_source.size()
+      || edit.removed > m_source.size() - edit.offset) {
+    throw std::out_of_range("The edit is past the end of the source");
+  }
+  auto const shift = static_cast<std::int64_t>(edit.inserted.size())
+      - static_cast<std::int64_t>(edit.removed);
+  return reparse(rescan(edit), shift);
+}
+
+void Document::scan_all() {
+  Scanner scanner(m_source, 0, m_scan_errors);
+  for (auto token = scanner.next_token();; token = scanner.next_token()) {
+    m_tokens.push_back(token);
+    if (token.type() == TokenType::END_OF_FILE) {
+      break;
+    }
+  }
+  if (scanner.m_open_string) {
+    m_scan_errors.push_back(
+        {*scanner.m_open_string,
+         static_cast<std::uint32_t>(m_source.size() - *scanner.m_open_string),
+         DiagnosticCode::UNTERMINATED_STRING});
+  }
+  m_tokens.set_lines(scanner.lines());
+}
+
+void Document::report(DiagnosticSink &diagnostics) const {
+  for (auto const &error : m_scan_errors) {
+    diagnostics.report(error.code, lines(), error.offset, error.length);
+  }
+  for (auto const &[token, code] : m_syntax_errors) {
+    diagnostics.report(
+        code,
+        lines(),
+        token.offset(),
+        static_cast<std::uint32_t>(token.lexeme().size()),
+        token.type());
+  }
+}
+
+void Document::parse_all() {
+  // the errors are kept, to be reported on demand
+  Parser parser(m_tokens, 0, m_tokens.size() - 1);
+  m_ast = parser.parse_without_reporting();
+  m_syntax_errors = parser.errors();
+}
+
+Document::Rescan Document::rescan(TextEdit const &edit) {
+  auto const old_end = edit.offset + edit.removed;
+  auto const shift = static_cast<std::int64_t>(edit.inserted.size())
+      - static_cast<std::int64_t>(edit.removed);
+  m_source.replace(edit.offset, edit.removed, edit.inserted);
+  m_tokens.lines().apply_edit(edit.offset, edit.removed, edit.inserted);
+  std::string_view const source = m_source;
+
+  // the first token that ends at the edit or past it could change, and so
+  // could the one before it, which may have looked at the characters after it
+  std::size_t low = 0;
+  std::size_t high = m_tokens.size() - 1;
+  while (low < high) {
+    auto const mid = low + (high - low) / 2;
+    if (m_tokens.offset(mid) + m_tokens.length(mid) < edit.offset) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  auto first = low == 0 ? 0 : low - 1;
+  auto const begin = low == 0 ? 0 : m_tokens.offset(first);
+
+  // scan until a token is the same as an old one after the edit
+  auto const same_as = [this](
+                           std::size_t const old,
+                           Token const &token,
+                           std::int64_t const old_shift) {
+    return m_tokens.offset(old) + old_shift == token.offset()
+        && m_tokens.type(old) == token.type()
+        && m_tokens.length(old) == token.lexeme().size();
+  };
+  TokenBuffer scanned(source);
+  std::vector<ScanError> errors;
+  Scanner scanner(source, begin, errors);
+  auto const sync_from = edit.offset + edit.inserted.size();
+  auto old_last = first;
+  std::size_t num_scanned = 0;
+  for (;;) {
+    auto const token = scanner.next_token();
+    ++num_scanned;
+    if (token.type() == TokenType::END_OF_FILE) {
+      old_last = m_tokens.size() - 1;
+      break;
+    }
+    if (token.offset() >= sync_from) {
+      while (m_tokens.offset(old_last) < old_end
+             || m_tokens.offset(old_last) + shift < token.offset()) {
+        ++old_last;
+      }
+      if (same_as(old_last, token, shift)) {
+        break;
+      }
+    }
+    if (scanned.size() == 0 && token.offset() + token.lexeme().size()
+            <= edit.offset && same_as(first, token, 0)) {
+      // the tokens right before the edit usually don't change after all
+      ++first;
+      continue;
+    }
+    scanned.push_back(token);
+  }
+  if (scanner.m_open_string) {
+    errors.push_back(
+        {*scanner.m_open_string,
+         static_cast<std::uint32_t>(source.size() - *scanner.m_open_string),
+         DiagnosticCode::UNTERMINATED_STRING});
+  }
+
+  // the errors in the scanned part are replaced, and the ones after it move
+  auto const old_sync = m_tokens.offset(old_last);
+  std::vector<ScanError> merged;
+  for (auto const &error : m_scan_errors) {
+    if (error.offset < begin) {
+      merged.push_back(error);
+    }
+  }
+  merged.insert(merged.end(), errors.begin(), errors.end());
+  for (auto error : m_scan_errors) {
+    if (error.offset >= old_sync) {
+      error.offset = static_cast<std::uint32_t>(error.offset + shift);
+      merged.push_back(error);
+    }
+  }
+  m_scan_errors = std::move(merged);
+
+  auto const old_balanced = balanced(first, old_last);
+  m_tokens.replace(first, old_last, scanned, shift);
+  return {
+      first,
+      old_last,
+      first + scanned.size(),
+      num_scanned,
+      old_balanced};
+}
+
+EditStats Document::reparse(Rescan const &rescan, std::int64_t const shift) {
+  auto const parse_from_scratch = [&] {
+    parse_all();
+    return EditStats{rescan.scanned, m_ast ? m_ast->size() : 0, true};
+  };
+  if (!m_ast || !rescan.old_balanced
+      || !balanced(rescan.first, rescan.new_last)) {
+    return parse_from_scratch();
+  }
+
+  // the innermost parentheses around the changed tokens
+  std::optional<std::size_t> open;
+  std::size_t depth = 0;
+  for (auto idx = rescan.first; idx > 0 && !open; --idx) {
+    auto const type = m_tokens.type(idx - 1);
+    if (type == TokenType::RIGHT_PAREN) {
+      ++depth;
+    } else if (type == TokenType::LEFT_PAREN) {
+      if (depth == 0) {
+        open = idx - 1;
+      } else {
+        --depth;
+      }
+    }
+  }
+  if (!open) {
+    return parse_from_scratch();
+  }
+  // they balance each other, and so do the tokens in between
+  auto close = rescan.new_last;
+  for (; close < m_tokens.size(); ++close) {
+    auto const type = m_tokens.type(close);
+    if (type == TokenType::LEFT_PAREN) {
+      ++depth;
+    } else if (type == TokenType::RIGHT_PAREN) {
+      if (depth == 0) {
+        break;
+      }
+      --depth;
+    }
+  }
+  if (close == m_tokens.size()) {
+    return parse_from_scratch();
+  }
+
+  Parser parser(m_tokens, *open + 1, close);
+  auto const subtree = parser.parse_without_reporting();
+  if (!subtree) {
+    return parse_from_scratch();
+  }
+  // the parentheses right around the subtree count towards its groups too
+  std::size_t groups = subtree->node(subtree->root()).groups + 1U;
+  for (std::size_t outer = 1; outer <= *open
+       && close + outer < m_tokens.size()
+       && m_tokens.type(*open - outer) == TokenType::LEFT_PAREN
+       && m_tokens.type(close + outer) == TokenType::RIGHT_PAREN;
+       ++outer) {
+    ++groups;
+  }
+  if (groups > Ast::max_groups) {
+    return parse_from_scratch();
+  }
+
+  // the old subtree is made of the nodes between the parentheses, before the
+  // edit moved the closing one
+  auto const from = m_tokens.offset(*open);
+  auto const to = static_cast<std::uint32_t>(m_tokens.offset(close) - shift);
+  auto const nodes = m_ast->nodes();
+  auto const inside = [&](Node const &node) {
+    return node.offset > from && node.offset < to;
+  };
+  // its root is the first node inside them on the way down from the root of
+  // the AST: the operator of every node above it is outside them, on the side
+  // of the other operand
+  auto last = m_ast->root();
+  while (!inside(nodes[last])) {
+    auto const &node = nodes[last];
+    last = node.kind == NodeKind::BINARY && from < node.offset
+        ? m_ast->left(last)
+        : Ast::operand(last);
+  }
+  // and its first node is its leftmost leaf
+  auto first = last;
+  for (;;) {
+    auto const kind = nodes[first].kind;
+    if (kind == NodeKind::BINARY) {
+      first = m_ast->left(first);
+    } else if (kind == NodeKind::UNARY) {
+      first = Ast::operand(first);
+    } else {
+      break;
+    }
+  }
+
+  m_ast->replace_subtree(
+      first,
+      last,
+      *subtree,
+      static_cast<std::uint16_t>(groups),
+      to,
+      shift);
+  return {rescan.scanned, subtree->size(), false};
+}
+
+/// Whether the parentheses of the tokens [first, last) balance each other
+bool Document::balanced(std::size_t const first, std::size_t const last)
+    const {
+  std::size_t depth = 0;
+  for (auto idx = first; idx < last; ++idx) {
+    auto const type = m_tokens.type(idx);
+    if (type == TokenType::LEFT_PAREN) {
+      ++depth;
+    } else if (type == TokenType::RIGHT_PAREN) {
+      if (depth == 0) {
+        return false;
+      }
+      --depth;
+    }
+  }
+  return depth == 0;
+}
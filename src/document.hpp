@@ -0,0 +1,105 @@
+#ifndef DOCUMENT_HPP
+#define DOCUMENT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.hpp"
+#include "diagnostics.hpp"
+#include "line_table.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "token_buffer.hpp"
+
+/// An edit of a source: the `removed` bytes at `offset` are replaced by
+/// `inserted`
+struct TextEdit {
+  std::uint32_t offset;
+  std::uint32_t removed;
+  std::string_view inserted;
+};
+
+/// What an edit took to bring a Document up to date
+struct EditStats {
+  std::size_t tokens_scanned; // including the one the scan resynchronized on
+  std::size_t nodes_parsed;
+  bool full_parse;
+};
+
+/// A source being edited, e.g. in an editor, with its tokens, lines and AST,
+/// which are kept up to date with every edit without scanning and parsing the
+/// whole source again.
+///
+/// The scanner starts again one token before the edit, and stops as soon as it
+/// produces a token that was already there, at the same place in the text after
+/// the edit: the scanner holds no state between tokens, so all the following
+/// tokens are the same as before. Then only the innermost parentheses around
+/// the changed tokens are parsed again, and their subtree replaces the old one.
+/// When there are no such parentheses, or the changed tokens don't balance
+/// theirs, the whole token stream is parsed again, which is still cheaper than
+/// scanning it. So every edit at the top level of the expression, outside of
+/// any parentheses, parses the whole source again.
+///
+/// The result is always the same as scanning and parsing the new source from
+/// scratch.
+class Document {
+private:
+  std::string m_source;
+  TokenBuffer m_tokens;
+  std::vector<ScanError> m_scan_errors;
+  std::optional<Ast> m_ast;
+  std::vector<SyntaxError> m_syntax_errors;
+
+public:
+  explicit Document(std::string source);
+  // the tokens and errors point into m_source
+  Document(Document const &) = delete;
+  Document &operator=(Document const &) = delete;
+
+  /// Apply the edit to the source, and update the tokens and the AST
+  EditStats edit(TextEdit const &edit);
+
+  [[nodiscard]] std::string_view source() const {
+    return m_source;
+  }
+  [[nodiscard]] LineTable const &lines() const {
+    return m_tokens.lines();
+  }
+  /// The tokens of the source, up to and including END_OF_FILE
+  [[nodiscard]] TokenBuffer const &tokens() const {
+    return m_tokens;
+  }
+  [[nodiscard]] std::vector<ScanError> const &scan_errors() const {
+    return m_scan_errors;
+  }
+  /// The AST of the source, if it has no syntax errors
+  [[nodiscard]] std::optional<Ast> const &ast() const {
+    return m_ast;
+  }
+  [[nodiscard]] std::vector<SyntaxError> const &syntax_errors() const {
+    return m_syntax_errors;
+  }
+  /// Report the scan errors and the syntax errors of the source
+  void report(DiagnosticSink &diagnostics) const;
+
+private:
+  struct Rescan {
+    std::size_t first; // the first token scanned again
+    std::size_t old_last; // the old token the scan resynchronized on
+    std::size_t new_last; // the same token, after the new tokens
+    std::size_t scanned; // the number of tokens scanned
+    bool old_balanced; // whether the old tokens balanced their parentheses
+  };
+
+  Rescan rescan(TextEdit const &edit);
+  EditStats reparse(Rescan const &rescan, std::int64_t shift);
+  void scan_all();
+  void parse_all();
+  [[nodiscard]] bool balanced(std::size_t first, std::size_t last) const;
+};
+
+#endif // DOCUMENT_HPP
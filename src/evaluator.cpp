@@ -0,0 +1,80 @@
+#include <string>
+
+#include "evaluator.hpp"
+#include "interner.hpp"
+
+Value Evaluator::visit_binary(NodeIndex const idx, Node const &node) {
+  auto const left = visit(m_ast.left(idx));
+  auto const right = visit(Ast::right(idx));
+
+  switch (node.oper) {
+  case TokenType::EQUAL_EQUAL: {
+    return Value(left == right);
+  }
+  case TokenType::BANG_EQUAL: {
+    return Value(!(left == right));
+  }
+  case TokenType::PLUS: {
+    if (left.is_number() && right.is_number()) {
+      return Value(left.as_number() + right.as_number());
+    }
+    if (left.is_string() && right.is_string()) {
+      auto &interner = Interner::global();
+      auto concatenation = std::string(interner.view(left.as_string()));
+      concatenation.append(interner.view(right.as_string()));
+      return Value(interner.intern(concatenation));
+    }
+    error(node, "Operands must be two numbers or two strings.");
+  }
+  default: {
+    break;
+  }
+  }
+
+  if (!left.is_number() || !right.is_number()) {
+    error(node, "Operands must be numbers.");
+  }
+  auto const lhs = left.as_number();
+  auto const rhs = right.as_number();
+  switch (node.oper) {
+  case TokenType::MINUS: {
+    return Value(lhs - rhs);
+  }
+  case TokenType::STAR: {
+    return Value(lhs * rhs);
+  }
+  case TokenType::SLASH: {
+    return Value(lhs / rhs);
+  }
+  case TokenType::LESS: {
+    return Value(lhs < rhs);
+  }
+  case TokenType::LESS_EQUAL: {
+    return Value(lhs <= rhs);
+  }
+  case TokenType::GREATER: {
+    return Value(lhs > rhs);
+  }
+  case TokenType::GREATER_EQUAL: {
+    return Value(lhs >= rhs);
+  }
+  default: {
+    __builtin_unreachable();
+  }
+  }
+}
+
+Value Evaluator::visit_unary(NodeIndex const idx, Node const &node) {
+  auto const operand = visit(Ast::operand(idx));
+  if (node.oper == TokenType::BANG) {
+    return Value(!operand.is_truthy());
+  }
+  if (!operand.is_number()) {
+    error(node, "Operand must be a number.");
+  }
+  return Value(-operand.as_number());
+}
+
+void Evaluator::error(Node const &node, std::string_view const message) const {
+  throw RuntimeError(message, m_lines.line(node.offset));
+}
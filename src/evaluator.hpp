@@ -0,0 +1,70 @@
+#ifndef EVALUATOR_HPP
+#define EVALUATOR_HPP
+
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <string_view>
+
+#include "ast.hpp"
+#include "ast_visitor.hpp"
+#include "line_table.hpp"
+#include "value.hpp"
+
+/// An error raised while evaluating, such as adding a number to a string
+class RuntimeError : public std::exception {
+private:
+  std::string m_message;
+  std::size_t m_line;
+
+public:
+  RuntimeError(std::string_view const message, std::size_t const line)
+      : m_message(message),
+        m_line(line) {}
+
+  [[nodiscard]] char const *what() const noexcept override {
+    return m_message.c_str();
+  }
+  /// The line of the operator that failed
+  [[nodiscard]] std::size_t line() const {
+    return m_line;
+  }
+};
+
+/// A tree-walking evaluator: computes the Value of an expression by visiting
+/// its nodes. Type errors are thrown as RuntimeError, with the line of the
+/// offending operator looked up in `lines`.
+class Evaluator : public AstVisitor<Evaluator, Value> {
+private:
+  LineTable const &m_lines;
+
+public:
+  Evaluator(Ast const &ast, LineTable const &lines)
+      : AstVisitor(ast),
+        m_lines(lines) {}
+
+  /// Evaluate the whole expression
+  Value evaluate() {
+    return visit(m_ast.root());
+  }
+
+  Value visit_binary(NodeIndex idx, Node const &node);
+  Value visit_unary(NodeIndex idx, Node const &node);
+  Value visit_number(NodeIndex /*idx*/, Node const &node) {
+    return Value(m_ast.number(node));
+  }
+  Value visit_string(NodeIndex /*idx*/, Node const &node) {
+    return Value(Ast::string(node));
+  }
+  Value visit_bool(NodeIndex /*idx*/, Node const &node) {
+    return Value(Ast::boolean(node));
+  }
+  Value visit_nil(NodeIndex /*idx*/, Node const & /*node*/) {
+    return {};
+  }
+
+private:
+  [[noreturn]] void error(Node const &node, std::string_view message) const;
+};
+
+#endif // EVALUATOR_HPP
@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "interner.hpp"
+
+Interner &Interner::global() {
+  static Interner interner;
+  return interner;
+}
+
+/// Return the symbol of `str`, adding it to the interner if it's the first time
+/// we see it
+Symbol Interner::intern(std::string_view const str) {
+  {
+    // most strings are repeated, so try the cheap path first
+    std::shared_lock lock(m_mutex);
+    if (auto it = m_symbols.find(str); it != m_symbols.end()) {
+      return it->second;
+    }
+  }
+
+  std::unique_lock lock(m_mutex);
+  // another thread may have interned the same string while we were unlocked
+  if (auto it = m_symbols.find(str); it != m_symbols.end()) {
+    return it->second;
+  }
+
+  auto const stored = store(str);
+  Symbol const symbol(static_cast<std::uint32_t>(m_strings.size()));
+  m_strings.push_back(stored);
+  m_symbols.emplace(stored, symbol);
+  return symbol;
+}
+
+std::string_view Interner::view(Symbol const symbol) const {
+  std::shared_lock lock(m_mutex);
+  return m_strings[symbol.id()];
+}
+
+std::size_t Interner::size() const {
+  std::shared_lock lock(m_mutex);
+  return m_strings.size();
+}
+
+/// Copy `str` in the block storage and return a view of the copy.
+/// The caller must hold the exclusive lock.
+std::string_view Interner::store(std::string_view const str) {
+  if (str.empty()) {
+    return {};
+  }
+
+  if (str.size() > block_size - m_block_used) {
+    // strings larger than a block get a block of their own
+    m_blocks.push_back(
+        std::make_unique_for_overwrite<char[]>(std::max(block_size, str.size())));
+    m_block_used = 0;
+  }
+
+  char *dst = m_blocks.back().get() + m_block_used;
+  std::memcpy(dst, str.data(), str.size());
+  m_block_used = std::min(block_size, m_block_used + str.size());
+  return {dst, str.size()};
+}
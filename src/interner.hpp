@@ -0,0 +1,60 @@
+#ifndef INTERNER_HPP
+#define INTERNER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// A symbol is the handle of an interned string. Two symbols from the same
+/// interner compare equal if and only if their strings are equal.
+class Symbol {
+  std::uint32_t m_id{};
+
+public:
+  Symbol() = default;
+  explicit Symbol(std::uint32_t const id) : m_id(id) {}
+
+  [[nodiscard]] std::uint32_t id() const {
+    return m_id;
+  }
+
+  friend bool operator==(Symbol, Symbol) = default;
+};
+
+/// The interner keeps one canonical copy of every distinct string it has seen
+/// and hands out a compact Symbol for each of them. The copies are stored in
+/// large blocks that are never moved or freed, so the views returned by
+/// `view()` stay valid for the lifetime of the interner.
+///
+/// All the member functions are safe to call concurrently.
+class Interner {
+private:
+  static constexpr std::size_t block_size = 64 * 1024;
+
+  mutable std::shared_mutex m_mutex;
+  std::unordered_map<std::string_view, Symbol> m_symbols;
+  std::vector<std::string_view> m_strings; // indexed by symbol id
+  std::vector<std::unique_ptr<char[]>> m_blocks;
+  std::size_t m_block_used{block_size}; // bytes used in the last block
+
+public:
+  Interner() = default;
+  Interner(Interner const &) = delete;
+  Interner &operator=(Interner const &) = delete;
+
+  /// The interner shared by the scanner, the tokens and the AST
+  static Interner &global();
+
+  Symbol intern(std::string_view str);
+  [[nodiscard]] std::string_view view(Symbol symbol) const;
+  [[nodiscard]] std::size_t size() const;
+
+private:
+  std::string_view store(std::string_view str);
+};
+
+#endif // INTERNER_HPP
@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+#include "jit.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define CPPLOX_JIT 1
+#include <sys/mman.h>
+#endif
+
+#ifdef CPPLOX_JIT
+namespace {
+/// What a node evaluates to, if it's in the numeric subset
+enum class NodeType : std::uint8_t {
+  UNSUPPORTED,
+  NUMBER,
+  BOOL, // a comparison of numbers, which is only supported at the root
+};
+
+bool is_arithmetic(TokenType const oper) {
+  return oper == TokenType::PLUS || oper == TokenType::MINUS
+      || oper == TokenType::STAR || oper == TokenType::SLASH;
+}
+
+/// The type of the root of `ast`, which is UNSUPPORTED if any node is outside
+/// the numeric subset
+NodeType root_type(Ast const &ast) {
+  std::vector<NodeType> types(ast.size(), NodeType::UNSUPPORTED);
+  for (NodeIndex idx = 0; idx < ast.size(); ++idx) {
+    auto const &node = ast.node(idx);
+    switch (node.kind) {
+    case NodeKind::NUMBER: {
+      types[idx] = NodeType::NUMBER;
+      break;
+    }
+    case NodeKind::UNARY: {
+      if (node.oper == TokenType::MINUS
+          && types[Ast::operand(idx)] == NodeType::NUMBER) {
+        types[idx] = NodeType::NUMBER;
+      }
+      break;
+    }
+    case NodeKind::BINARY: {
+      if (types[ast.left(idx)] == NodeType::NUMBER
+          && types[Ast::right(idx)] == NodeType::NUMBER) {
+        types[idx] =
+            is_arithmetic(node.oper) ? NodeType::NUMBER : NodeType::BOOL;
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+    }
+  }
+  return types[ast.root()];
+}
+
+enum class Prefix : std::uint8_t {
+  SCALAR_DOUBLE = 0xf2, // the sd instructions
+  PACKED_DOUBLE = 0x66, // the pd instructions
+};
+
+enum class Opcode : std::uint8_t {
+  MOVSD_LOAD = 0x10,
+  MOVSD_STORE = 0x11,
+  MOVAPD = 0x28,
+  ANDPD = 0x54,
+  XORPD = 0x57,
+  ADDSD = 0x58,
+  MULSD = 0x59,
+  SUBSD = 0x5c,
+  DIVSD = 0x5e,
+  CMPSD = 0xc2,
+};
+
+/// The predicates of CMPSD, which all compare false when a NaN is involved,
+/// but NEQ
+enum class Predicate : std::uint8_t {
+  EQ = 0,
+  LT = 1,
+  LE = 2,
+  NEQ = 4,
+};
+
+enum class Base : std::uint8_t {
+  RSI = 6, // the spilled slots
+  RDI = 7, // the constants
+};
+
+/// Encodes the few SSE2 instructions the JIT needs, on xmm registers and on
+/// memory operands of the form [base + disp32]
+class Assembler {
+private:
+  std::vector<std::uint8_t> m_code;
+
+public:
+  /// `op xmm<dst>, xmm<src>`
+  void op(
+      Prefix const prefix,
+      Opcode const opcode,
+      unsigned const dst,
+      unsigned const src) {
+    m_code.push_back(static_cast<std::uint8_t>(prefix));
+    rex(dst, src);
+    m_code.push_back(0x0f);
+    m_code.push_back(static_cast<std::uint8_t>(opcode));
+    m_code.push_back(
+        static_cast<std::uint8_t>(0xc0U | (dst & 7U) << 3U | (src & 7U)));
+  }
+
+  /// `op xmm<reg>, [base + disp]`, or `op [base + disp], xmm<reg>` for stores
+  void op(
+      Prefix const prefix,
+      Opcode const opcode,
+      unsigned const reg,
+      Base const base,
+      std::size_t const disp) {
+    m_code.push_back(static_cast<std::uint8_t>(prefix));
+    rex(reg, 0);
+    m_code.push_back(0x0f);
+    m_code.push_back(static_cast<std::uint8_t>(opcode));
+    m_code.push_back(static_cast<std::uint8_t>(
+        0x80U | (reg & 7U) << 3U | static_cast<unsigned>(base)));
+    for (unsigned byte = 0; byte < 4; ++byte) {
+      m_code.push_back(static_cast<std::uint8_t>(disp >> (8U * byte)));
+    }
+  }
+
+  /// `cmpsd xmm<dst>, xmm<src>, predicate`
+  void
+  cmpsd(unsigned const dst, unsigned const src, Predicate const predicate) {
+    op(Prefix::SCALAR_DOUBLE, Opcode::CMPSD, dst, src);
+    m_code.push_back(static_cast<std::uint8_t>(predicate));
+  }
+
+  void ret() {
+    m_code.push_back(0xc3);
+  }
+
+  [[nodiscard]] std::vector<std::uint8_t> const &code() const {
+    return m_code;
+  }
+
+private:
+  /// The REX prefix to reach registers xmm8 to xmm15, if needed
+  void rex(unsigned const reg, unsigned const rm) {
+    if (reg >= 8 || rm >= 8) {
+      m_code.push_back(static_cast<std::uint8_t>(
+          0x40U | (reg >= 8 ? 4U : 0U) | (rm >= 8 ? 1U : 0U)));
+    }
+  }
+};
+
+/// Compiles the stack machine code of an Ast: slot `n` of the stack is xmm<n>
+/// up to xmm13, and then the double `n - 14` of the spill area at rsi. xmm14
+/// is a scratch register, and xmm15 holds the sign mask for negations. The
+/// constants are at rdi.
+class CodeGenerator {
+public:
+  static constexpr unsigned num_slot_registers = 14;
+
+private:
+  static constexpr unsigned scratch = 14;
+  static constexpr unsigned sign_mask = 15;
+
+  Assembler m_assembler;
+  std::vector<double> m_constants;
+  std::unordered_map<std::uint64_t, std::size_t> m_constant_indices;
+  std::size_t m_depth{};
+  std::size_t m_max_depth{};
+
+public:
+  CodeGenerator() {
+    load_constant(sign_mask, -0.0); // only the sign bit is set
+  }
+
+  void number(double const value) {
+    auto const slot = m_depth++;
+    m_max_depth = std::max(m_max_depth, m_depth);
+    load_constant(is_register(slot) ? register_of(slot) : scratch, value);
+    if (!is_register(slot)) {
+      store(slot, scratch);
+    }
+  }
+
+  void negate() {
+    auto const slot = m_depth - 1;
+    if (is_register(slot)) {
+      m_assembler.op(
+          Prefix::PACKED_DOUBLE, Opcode::XORPD, register_of(slot), sign_mask);
+    } else {
+      load(scratch, slot);
+      m_assembler.op(Prefix::PACKED_DOUBLE, Opcode::XORPD, scratch, sign_mask);
+      store(slot, scratch);
+    }
+  }
+
+  void arithmetic(TokenType const oper) {
+    auto const opcode = oper == TokenType::PLUS ? Opcode::ADDSD
+        : oper == TokenType::MINUS              ? Opcode::SUBSD
+        : oper == TokenType::STAR               ? Opcode::MULSD
+                                                : Opcode::DIVSD;
+    auto const right = --m_depth;
+    auto const left = right - 1;
+    if (is_register(right)) {
+      m_assembler.op(
+          Prefix::SCALAR_DOUBLE, opcode, register_of(left), register_of(right));
+    } else if (is_register(left)) {
+      m_assembler.op(
+          Prefix::SCALAR_DOUBLE,
+          opcode,
+          register_of(left),
+          Base::RSI,
+          spill_offset(right));
+    } else {
+      load(scratch, left);
+      m_assembler.op(
+          Prefix::SCALAR_DOUBLE,
+          opcode,
+          scratch,
+          Base::RSI,
+          spill_offset(right));
+      store(left, scratch);
+    }
+  }
+
+  /// A comparison, which is always at the root, so its operands are in xmm0
+  /// and xmm1. The result is 1.0 if it's true, and 0.0 otherwise.
+  void comparison(TokenType const oper) {
+    --m_depth;
+    switch (oper) {
+    case TokenType::EQUAL_EQUAL: {
+      m_assembler.cmpsd(0, 1, Predicate::EQ);
+      break;
+    }
+    case TokenType::BANG_EQUAL: {
+      m_assembler.cmpsd(0, 1, Predicate::NEQ);
+      break;
+    }
+    case TokenType::LESS: {
+      m_assembler.cmpsd(0, 1, Predicate::LT);
+      break;
+    }
+    case TokenType::LESS_EQUAL: {
+      m_assembler.cmpsd(0, 1, Predicate::LE);
+      break;
+    }
+    case TokenType::GREATER: {
+      m_assembler.cmpsd(1, 0, Predicate::LT);
+      m_assembler.op(Prefix::PACKED_DOUBLE, Opcode::MOVAPD, 0, 1);
+      break;
+    }
+    default: { // GREATER_EQUAL
+      m_assembler.cmpsd(1, 0, Predicate::LE);
+      m_assembler.op(Prefix::PACKED_DOUBLE, Opcode::MOVAPD, 0, 1);
+      break;
+    }
+    }
+    // the comparison leaves a mask of all ones or all zeros
+    load_constant(scratch, 1.0);
+    m_assembler.op(Prefix::PACKED_DOUBLE, Opcode::ANDPD, 0, scratch);
+  }
+
+  /// The result is in xmm0, where the SysV ABI returns doubles
+  void ret() {
+    m_assembler.ret();
+  }
+
+  [[nodiscard]] std::vector<std::uint8_t> const &code() const {
+    return m_assembler.code();
+  }
+  [[nodiscard]] std::vector<double> &constants() {
+    return m_constants;
+  }
+  [[nodiscard]] std::size_t num_spilled() const {
+    return m_max_depth > num_slot_registers ? m_max_depth - num_slot_registers
+                                            : 0;
+  }
+
+private:
+  static bool is_register(std::size_t const slot) {
+    return slot < num_slot_registers;
+  }
+  static unsigned register_of(std::size_t const slot) {
+    return static_cast<unsigned>(slot);
+  }
+  static std::size_t spill_offset(std::size_t const slot) {
+    return (slot - num_slot_registers) * sizeof(double);
+  }
+
+  void load(unsigned const reg, std::size_t const slot) {
+    m_assembler.op(
+        Prefix::SCALAR_DOUBLE,
+        Opcode::MOVSD_LOAD,
+        reg,
+        Base::RSI,
+        spill_offset(slot));
+  }
+  void store(std::size_t const slot, unsigned const reg) {
+    m_assembler.op(
+        Prefix::SCALAR_DOUBLE,
+        Opcode::MOVSD_STORE,
+        reg,
+        Base::RSI,
+        spill_offset(slot));
+  }
+
+  void load_constant(unsigned const reg, double const value) {
+    auto const [it, inserted] = m_constant_indices.try_emplace(
+        std::bit_cast<std::uint64_t>(value), m_constants.size());
+    if (inserted) {
+      m_constants.push_back(value);
+    }
+    m_assembler.op(
+        Prefix::SCALAR_DOUBLE,
+        Opcode::MOVSD_LOAD,
+        reg,
+        Base::RDI,
+        it->second * sizeof(double));
+  }
+};
+} // namespace
+#endif
+
+JitFunction::JitFunction(JitFunction &&other) noexcept
+    : m_code(std::exchange(other.m_code, nullptr)),
+      m_code_size(std::exchange(other.m_code_size, 0)),
+      m_constants(std::move(other.m_constants)),
+      m_spill(std::move(other.m_spill)),
+      m_returns_bool(other.m_returns_bool) {}
+
+JitFunction &JitFunction::operator=(JitFunction &&other) noexcept {
+  std::swap(m_code, other.m_code);
+  std::swap(m_code_size, other.m_code_size);
+  std::swap(m_constants, other.m_constants);
+  std::swap(m_spill, other.m_spill);
+  std::swap(m_returns_bool, other.m_returns_bool);
+  return *this;
+}
+
+JitFunction::~JitFunction() {
+#ifdef CPPLOX_JIT
+  if (m_code != nullptr) {
+    munmap(m_code, m_code_size);
+  }
+#endif
+}
+
+bool JitFunction::supported() {
+#ifdef CPPLOX_JIT
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::optional<JitFunction> JitFunction::compile(Ast const &ast) {
+#ifdef CPPLOX_JIT
+  if (ast.empty()) {
+    return std::nullopt;
+  }
+  auto const type = root_type(ast);
+  if (type == NodeType::UNSUPPORTED) {
+    return std::nullopt;
+  }
+
+  CodeGenerator generator;
+  for (auto const &node : ast.nodes()) {
+    switch (node.kind) {
+    case NodeKind::NUMBER: {
+      generator.number(ast.number(node));
+      break;
+    }
+    case NodeKind::UNARY: {
+      generator.negate();
+      break;
+    }
+    case NodeKind::BINARY: {
+      if (is_arithmetic(node.oper)) {
+        generator.arithmetic(node.oper);
+      } else {
+        generator.comparison(node.oper);
+      }
+      break;
+    }
+    default: {
+      __builtin_unreachable();
+    }
+    }
+  }
+  generator.ret();
+
+  auto const &code = generator.code();
+  auto *const memory = mmap(
+      nullptr,
+      code.size(),
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1,
+      0);
+  if (memory == MAP_FAILED) {
+    return std::nullopt;
+  }
+  std::memcpy(memory, code.data(), code.size());
+  if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, code.size());
+    return std::nullopt;
+  }
+
+  JitFunction function;
+  function.m_code = memory;
+  function.m_code_size = code.size();
+  function.m_constants = std::move(generator.constants());
+  function.m_spill.resize(generator.num_spilled());
+  function.m_returns_bool = type == NodeType::BOOL;
+  return function;
+#else
+  static_cast<void>(ast);
+  return std::nullopt;
+#endif
+}
+
+Value JitFunction::run() {
+#ifdef CPPLOX_JIT
+  using Code = double (*)(double const *constants, double *spill);
+  auto const code = reinterpret_cast<Code>(m_code);
+  auto const result = code(m_constants.data(), m_spill.data());
+  return m_returns_bool ? Value(result != 0.0) : Value(result);
+#else
+  return {};
+#endif
+}
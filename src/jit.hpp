@@ -0,0 +1,55 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "ast.hpp"
+#include "value.hpp"
+
+/// An expression compiled to x86-64 SSE2 machine code.
+///
+/// Only the numeric subset of Lox is compiled: number literals, `+ - * /`,
+/// unary minus, and a comparison at the root. Those can never fail at runtime,
+/// so the machine code needs no type checks and no error paths. Every other
+/// expression is left to the interpreters: `compile()` returns nothing for
+/// them, and always does on platforms other than x86-64 Linux.
+///
+/// The code is a template JIT of the VM's stack machine, where the stack slots
+/// are the registers xmm0 to xmm13, and the slots past those spill to memory.
+/// It is written to an anonymous mapping that is made executable (and no
+/// longer writable) before it's run.
+class JitFunction {
+private:
+  void *m_code{};
+  std::size_t m_code_size{};
+  std::vector<double> m_constants;
+  std::vector<double> m_spill;
+  bool m_returns_bool{};
+
+  JitFunction() = default;
+
+public:
+  JitFunction(JitFunction const &) = delete;
+  JitFunction &operator=(JitFunction const &) = delete;
+  JitFunction(JitFunction &&other) noexcept;
+  JitFunction &operator=(JitFunction &&other) noexcept;
+  ~JitFunction();
+
+  /// Whether this platform has a JIT at all
+  [[nodiscard]] static bool supported();
+
+  /// Compile `ast`, or return nothing if it's outside the numeric subset
+  [[nodiscard]] static std::optional<JitFunction> compile(Ast const &ast);
+
+  /// Run the compiled code
+  Value run();
+
+  /// The size of the machine code, in bytes
+  [[nodiscard]] std::size_t code_size() const {
+    return m_code_size;
+  }
+};
+
+#endif // JIT_HPP
@@ -0,0 +1,106 @@
+#ifndef LINE_TABLE_HPP
+#define LINE_TABLE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// The offsets in the source where each line starts, recorded by the scanner as
+/// it skips over newlines. Tokens only store their offset, and their line and
+/// column are looked up here when needed, e.g. to report an error.
+///
+/// Lines and columns are 1-based.
+class LineTable {
+private:
+  std::vector<std::uint32_t> m_line_starts{0};
+
+public:
+  LineTable() = default;
+  /// The table of the lines starting at `line_starts`, in increasing order
+  /// from zero, e.g. loaded from a cache
+  explicit LineTable(std::vector<std::uint32_t> line_starts)
+      : m_line_starts(std::move(line_starts)) {}
+
+  /// Record that a line starts at `offset`, i.e. that there's a newline right
+  /// before it. Lines must be added in increasing order.
+  void add_line(std::uint32_t const offset) {
+    m_line_starts.push_back(offset);
+  }
+
+  /// Append the lines recorded by another table for a later part of the same
+  /// source, e.g. by the scanner of the next chunk
+  void append(LineTable const &other) {
+    m_line_starts.insert(
+        m_line_starts.end(),
+        other.m_line_starts.begin() + 1,
+        other.m_line_starts.end());
+  }
+
+  /// Update the lines after the `removed` bytes at `offset` have been replaced
+  /// by `inserted`
+  void apply_edit(
+      std::uint32_t const offset,
+      std::uint32_t const removed,
+      std::string_view const inserted) {
+    // the lines that start right after a removed newline
+    auto const first = std::ranges::upper_bound(m_line_starts, offset);
+    auto const last = std::upper_bound(
+        first, m_line_starts.end(), offset + removed);
+    auto const shift = static_cast<std::int64_t>(inserted.size())
+        - static_cast<std::int64_t>(removed);
+    for (auto it = last; it != m_line_starts.end(); ++it) {
+      *it = static_cast<std::uint32_t>(*it + shift);
+    }
+
+    std::vector<std::uint32_t> inserted_starts;
+    for (std::size_t idx = 0; idx < inserted.size(); ++idx) {
+      if (inserted[idx] == '\n') {
+        inserted_starts.push_back(static_cast<std::uint32_t>(offset + idx + 1));
+      }
+    }
+    auto const pos = m_line_starts.erase(first, last);
+    m_line_starts.insert(pos, inserted_starts.begin(), inserted_starts.end());
+  }
+
+  /// The number of lines seen so far, which is also the last line
+  [[nodiscard]] std::size_t line_count() const {
+    return m_line_starts.size();
+  }
+
+  /// The offsets where the lines start, one per line
+  [[nodiscard]] std::span<std::uint32_t const> line_starts() const {
+    return m_line_starts;
+  }
+
+  /// The offset where `line` starts
+  [[nodiscard]] std::uint32_t line_start(std::size_t const line) const {
+    return m_line_starts[line - 1];
+  }
+
+  /// The offset where the line after `line` starts, or the largest offset if
+  /// it's the last line seen so far
+  [[nodiscard]] std::uint32_t line_end(std::size_t const line) const {
+    if (line < m_line_starts.size()) {
+      return m_line_starts[line];
+    }
+    return std::numeric_limits<std::uint32_t>::max();
+  }
+
+  [[nodiscard]] std::size_t line(std::uint32_t const offset) const {
+    auto const it = std::ranges::upper_bound(m_line_starts, offset);
+    return static_cast<std::size_t>(it - m_line_starts.begin());
+  }
+
+  [[nodiscard]] std::size_t column(std::uint32_t const offset) const {
+    return offset - m_line_starts[line(offset) - 1] + 1;
+  }
+
+  friend bool operator==(LineTable const &, LineTable const &) = default;
+};
+
+#endif // LINE_TABLE_HPP
@@ -1,25 +1,165 @@
 #include <algorithm>
-#include <fstream>
-#include <functional>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
-#include <sstream>
-#include <sysexits.h>  // EX_DATAERR
-#include <vector>  // std::vector
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sysexits.h>  // EX_DATAERR, EX_NOINPUT, EX_SOFTWARE
+#include <system_error>
+#include <utility>
+#include <vector>
 
+#include "ast_cache.hpp"
+#include "chunk.hpp"
+#include "compiler.hpp"
+#include "constant_folder.hpp"
+#include "diagnostics.hpp"
+#include "evaluator.hpp"
+#include "jit.hpp"
 #include "lox.hpp"
 #include "parser.hpp"
 #include "scanner.hpp"
+#include "source_file.hpp"
+#include "thread_pool.hpp"
+#include "tracer.hpp"
+#include "vm.hpp"
 
-/// Read the whole file at script_path into memory and pass its contents to
-/// `run()`.
+/// Map the file at script_path in memory and pass its contents to `run()`.
 /// In case of error it returns a non-zero value, else it returns zero.
 int Lox::run_file(char const *script_path) {
-  std::ifstream instream(script_path);
-  // read the whole file in memory
-  std::stringstream ss;
-  ss << instream.rdbuf();
-  run(ss.str().c_str());
+  TraceSpan const span("run_file", script_path);
+  // the phases are timed for the trace too
+  if (!m_options.stats && !Tracer::global().enabled()) {
+    StatsCollector<false> stats;
+    return run_file(script_path, stats);
+  }
+  StatsCollector<true> stats;
+  auto const status = run_file(script_path, stats);
+  if (m_options.stats) {
+    report(stats.stats());
+  }
+  return status;
+}
+
+template <typename Stats>
+int Lox::run_file(char const *script_path, Stats &stats) {
+  std::optional<SourceFile> source;
+  try {
+    stats.time(Phase::LOAD, [&] { source.emplace(script_path); });
+  } catch (std::system_error const &error) {
+    fmt::println(stderr, "Could not read script: {}", error.what());
+    return EX_NOINPUT;
+  }
+  if (m_options.cache_directory.empty()) {
+    run(source->contents(), stats);
+  } else {
+    run_cached(source->contents(), stats);
+  }
+
+  if (m_had_error) {
+    return EX_DATAERR;
+  }
+  if (m_had_runtime_error) {
+    return EX_SOFTWARE;
+  }
+  return 0;
+}
+
+/// Scan and parse the scripts at `paths`, and the `.lox` files in the
+/// directories among them, on a thread pool, without running them. The
+/// diagnostics of every file are printed in the order of the files, each
+/// prefixed by its path.
+/// Returns zero if every file is valid, else the status of the worst error.
+int Lox::check_files(std::span<char const *const> const paths) {
+  fmt::memory_buffer out;
+  bool unreadable = false;
 
+  std::vector<std::filesystem::path> files;
+  for (auto const *const path : paths) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(path, error)) {
+      files.emplace_back(path);
+      continue;
+    }
+    // the directory entries come in no particular order
+    std::vector<std::filesystem::path> scripts;
+    std::filesystem::recursive_directory_iterator it(path, error);
+    for (; !error && it != std::filesystem::recursive_directory_iterator();
+         it.increment(error)) {
+      if (it->is_regular_file() && it->path().extension() == ".lox") {
+        scripts.push_back(it->path());
+      }
+    }
+    if (error) {
+      fmt::format_to(
+          std::back_inserter(out),
+          "Could not read directory: {}: {}\n",
+          path,
+          error.message());
+      unreadable = true;
+    }
+    std::ranges::sort(scripts);
+    files.insert(files.end(), scripts.begin(), scripts.end());
+  }
+
+  struct Check {
+    std::string diagnostics;
+    bool had_error{};
+    bool unreadable{};
+  };
+  std::vector<Check> checks(files.size());
+  ThreadPool pool(m_options.jobs);
+  auto const format = m_options.diagnostic_format;
+  pool.run(files.size(), [&files, &checks, format](std::size_t const idx) {
+    auto &check = checks[idx];
+    auto const &path = files[idx].native();
+    TraceSpan const span("check", path);
+    std::optional<SourceFile> source;
+    try {
+      TraceSpan const load_span("load");
+      source.emplace(path.c_str());
+    } catch (std::system_error const &error) {
+      check.diagnostics =
+          fmt::format("{}: Could not read script: {}\n", path, error.what());
+      check.unreadable = true;
+      return;
+    }
+    // every file gets its own diagnostics, formatted while its source is
+    // still mapped
+    DiagnosticSink diagnostics(source->contents());
+    std::optional<Scanner> scanner;
+    try {
+      scanner.emplace(source->contents(), diagnostics);
+    } catch (std::length_error const &error) {
+      check.diagnostics = fmt::format("{}: Error: {}\n", path, error.what());
+      check.had_error = true;
+      return;
+    }
+    Parser parser(*scanner);
+    std::optional<Ast> ast;
+    {
+      TraceSpan const parse_span("scan and parse");
+      ast = parser.parse();
+    }
+    check.had_error = scanner->had_error() || !ast;
+    fmt::memory_buffer text;
+    diagnostics.format(text, format, path);
+    check.diagnostics = fmt::to_string(text);
+  });
+
+  m_had_error = false;
+  for (auto const &check : checks) {
+    out.append(check.diagnostics);
+    m_had_error = m_had_error || check.had_error;
+    unreadable = unreadable || check.unreadable;
+  }
+  std::fwrite(out.data(), 1, out.size(), stderr);
+
+  if (unreadable) {
+    return EX_NOINPUT;
+  }
   if (m_had_error) {
     return EX_DATAERR;
   }
@@ -38,25 +178,174 @@ int Lox::run_prompt() {
       std::cout << '\n';
       break;
     }
-    run(input_line.c_str());
+    run(input_line);
   }
   return 0;
 }
 
 /// Run the Lox interpreter on the `source` code
-void Lox::run(char const *source) {
-  Scanner scanner(source);
-  std::vector<Token> tokens = scanner.scan_tokens();
-  m_had_error = scanner.had_error();
+void Lox::run(std::string_view const source) {
+  if (!m_options.stats && !Tracer::global().enabled()) {
+    StatsCollector<false> stats;
+    run(source, stats);
+    return;
+  }
+  StatsCollector<true> stats;
+  run(source, stats);
+  if (m_options.stats) {
+    report(stats.stats());
+  }
+}
+
+template <typename Stats>
+void Lox::run(std::string_view const source, Stats &stats) {
+  stats.add_source(source.size());
+  if (auto script = parse(source, stats)) {
+    stats.time(Phase::RUN, [&] {
+      execute(std::move(script->ast), script->lines);
+    });
+  }
+}
+
+/// Run `source` from the cache if it has been parsed before, else parse it,
+/// and add it to the cache if it's valid
+template <typename Stats>
+void Lox::run_cached(std::string_view const source, Stats &stats) {
+  stats.add_source(source.size());
+  AstCache const cache(m_options.cache_directory);
+  auto const key =
+      stats.time(Phase::CACHE, [source] { return AstCache::key(source); });
+  auto script = stats.time(Phase::CACHE, [&] { return cache.load(key); });
+  if (script) {
+    stats.count_nodes(script->ast);
+    m_had_error = false;
+    m_had_runtime_error = false;
+  } else {
+    script = parse(source, stats);
+    if (!script) {
+      return;
+    }
+    try {
+      stats.time(Phase::CACHE, [&] { cache.store(key, *script); });
+    } catch (std::system_error const &error) {
+      // the script can still run
+      fmt::println(stderr, "Could not write to the cache: {}", error.what());
+    }
+  }
+  stats.time(Phase::RUN, [&] {
+    execute(std::move(script->ast), script->lines);
+  });
+}
 
-  Parser parser(tokens);
-  auto expr = parser.parse();
-  m_had_error = m_had_error || !expr;
+/// Scan and parse `source`, reporting its errors. Returns nothing if it has
+/// any.
+template <typename Stats>
+std::optional<ParsedScript> Lox::parse(
+    std::string_view const source,
+    Stats &stats) {
+  DiagnosticSink diagnostics(source);
+  std::optional<Scanner> scanner_storage;
+  try {
+    scanner_storage.emplace(source, diagnostics);
+  } catch (std::length_error const &error) {
+    fmt::println(stderr, "Error: {}", error.what());
+    m_had_error = true;
+    m_had_runtime_error = false;
+    return std::nullopt;
+  }
+  auto &scanner = *scanner_storage;
+  std::optional<ParsedScript> script;
+  if constexpr (Stats::enabled) {
+    // the scanner runs first, so that the phases can be timed apart
+    auto const tokens =
+        stats.time(Phase::SCAN, [&scanner] { return scanner.scan_tokens(); });
+    stats.count_tokens(tokens);
+    Parser parser(tokens, 0, tokens.size() - 1, tokens.lines(), diagnostics);
+    if (auto ast = stats.time(Phase::PARSE, [&] { return parser.parse(); })) {
+      script = ParsedScript{std::move(*ast), tokens.lines()};
+    }
+  } else {
+    Parser parser(scanner);
+    if (auto ast = parser.parse()) {
+      script = ParsedScript{std::move(*ast), scanner.lines()};
+    }
+  }
+  m_had_error = scanner.had_error() || !script;
+  m_had_runtime_error = false;
+  diagnostics.flush(stderr, m_options.diagnostic_format);
 
   if (m_had_error) {
+    return std::nullopt;
+  }
+  stats.count_nodes(script->ast);
+  return script;
+}
+
+void Lox::report(RunStats const &stats) const {
+  fmt::memory_buffer out;
+  stats.format(out, *m_options.stats);
+  std::fwrite(out.data(), 1, out.size(), stderr);
+}
+
+/// Run the parsed script `ast`, whose source has `lines`
+void Lox::execute(Ast ast, LineTable const &lines) {
+  auto const nodes_before = ast.node_count();
+  if (m_options.fold) {
+    TraceSpan const span("fold");
+    ast = fold_constants(ast);
+  }
+  if (m_options.node_count) {
+    if (m_options.fold) {
+      fmt::println(stderr, "nodes: {} -> {}", nodes_before, ast.node_count());
+    } else {
+      fmt::println(stderr, "nodes: {}", nodes_before);
+    }
+  }
+
+  if (m_options.print_ast) {
+    TraceSpan const span("print");
+    fmt::println("{}", ast.to_string());
     return;
   }
 
-  fmt::println("{}", expr->to_string());
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
+  try {
+    Value value;
+    std::optional<JitFunction> function;
+    if (m_options.backend == Backend::JIT) {
+      TraceSpan const span("compile");
+      function = JitFunction::compile(ast);
+    }
+
+    if (function) {
+      TraceSpan const span("evaluate");
+      value = function->run();
+    } else if (m_options.backend == Backend::AST) {
+      TraceSpan const span("evaluate");
+      value = Evaluator(ast, lines).evaluate();
+    } else {
+      auto const chunk = [&]() -> std::optional<Chunk> {
+        TraceSpan const span("compile");
+        try {
+          return compile(ast, lines);
+        } catch (std::length_error const &error) {
+          // the script is valid, but too large for one chunk
+          fmt::println(stderr, "Error: {}", error.what());
+          return std::nullopt;
+        }
+      }();
+      if (!chunk) {
+        m_had_error = true;
+        return;
+      }
+      if (m_options.dump_bytecode) {
+        fmt::print("{}", disassemble(*chunk));
+      }
+      TraceSpan const span("evaluate");
+      value = Vm().run(*chunk);
+    }
+    fmt::println("{}", value.to_string());
+  } catch (RuntimeError const &error) {
+    fmt::println(stderr, "{}\n[line {}]", error.what(), error.line());
+    m_had_runtime_error = true;
+  }
 }
@@ -1,16 +1,74 @@
 #ifndef LOX_HPP
 #define LOX_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "ast_cache.hpp"
+#include "diagnostics.hpp"
+#include "stats.hpp"
+
+/// How expressions are executed
+enum class Backend : std::uint8_t {
+  AST, // walk the AST
+  BYTECODE, // compile to bytecode and run it on the VM
+  JIT, // compile numeric expressions to machine code, the rest to bytecode
+};
+
+/// Command line switches of the interpreter
+struct LoxOptions {
+  Backend backend{Backend::BYTECODE};
+  /// Fold the constant subexpressions before running
+  bool fold{};
+  /// Report the number of AST nodes (before and after folding) on stderr
+  bool node_count{};
+  /// Print the AST instead of evaluating it
+  bool print_ast{};
+  /// Print the disassembled bytecode before running it
+  bool dump_bytecode{};
+  /// How syntax errors are reported on stderr
+  DiagnosticFormat diagnostic_format{DiagnosticFormat::TEXT};
+  /// The threads that check files in batch mode, zero for one per hardware
+  /// thread
+  std::size_t jobs{};
+  /// Where the scripts run from files are cached once parsed, empty to parse
+  /// them every time
+  std::string cache_directory;
+  /// Report the time spent in each phase of a run, and what they processed,
+  /// on stderr in this format. The scanner then runs before the parser
+  /// instead of feeding it, so all the scan errors come first.
+  std::optional<StatsFormat> stats;
+};
+
 class Lox {
 private:
+  LoxOptions m_options;
   bool m_had_error{};
+  bool m_had_runtime_error{};
 
 public:
-  explicit Lox() = default;
+  explicit Lox(LoxOptions const &options = {}) : m_options(options) {}
 
   int run_file(char const *script_path);
+  int check_files(std::span<char const *const> paths);
   int run_prompt();
-  void run(char const *source);
+  void run(std::string_view source);
+
+private:
+  template <typename Stats>
+  int run_file(char const *script_path, Stats &stats);
+  template <typename Stats>
+  void run(std::string_view source, Stats &stats);
+  template <typename Stats>
+  void run_cached(std::string_view source, Stats &stats);
+  template <typename Stats>
+  std::optional<ParsedScript> parse(std::string_view source, Stats &stats);
+  void execute(Ast ast, LineTable const &lines);
+  void report(RunStats const &stats) const;
 };
 
 #endif // LOX_HPP
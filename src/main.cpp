@@ -1,19 +1,100 @@
+#include <charconv>
 #include <iostream> // cerr
-#include <sysexits.h> // EX_USAGE
+#include <span>
+#include <string_view>
+#include <sysexits.h> // EX_CANTCREAT, EX_USAGE
+#include <system_error>
 
-#include "expr.hpp"
 #include "lox.hpp"
+#include "tracer.hpp"
 
 int main(int argc, char const *const *argv) {
-  if (argc > 2) {
-    std::cerr << "Usage: " << argv[0] << " [script]\n";
+  using namespace std::literals;
+
+  LoxOptions options;
+  char const *trace_path = nullptr;
+  bool check = false;
+  bool usage_error = false;
+  int arg = 1;
+  for (; arg < argc; ++arg) {
+    std::string_view const flag = argv[arg];
+    if (flag == "--check"sv) {
+      check = true;
+    } else if (flag == "--trace"sv) {
+      if (++arg == argc) {
+        usage_error = true;
+        break;
+      }
+      trace_path = argv[arg];
+    } else if (flag.starts_with("--jobs="sv)) {
+      auto const value = flag.substr("--jobs="sv.size());
+      auto const [end, error] = std::from_chars(
+          value.data(), value.data() + value.size(), options.jobs);
+      usage_error = usage_error || error != std::errc()
+          || end != value.data() + value.size();
+    } else if (flag.starts_with("--cache="sv)) {
+      options.cache_directory = flag.substr("--cache="sv.size());
+      usage_error = usage_error || options.cache_directory.empty();
+    } else if (flag == "--stats"sv) {
+      options.stats = StatsFormat::TABLE;
+    } else if (flag == "--stats=json"sv) {
+      options.stats = StatsFormat::JSON;
+    } else if (flag == "--diagnostics=text"sv) {
+      options.diagnostic_format = DiagnosticFormat::TEXT;
+    } else if (flag == "--diagnostics=json"sv) {
+      options.diagnostic_format = DiagnosticFormat::JSON_LINES;
+    } else if (argv[arg] == "--fold"sv) {
+      options.fold = true;
+    } else if (argv[arg] == "--node-count"sv) {
+      options.node_count = true;
+    } else if (argv[arg] == "--print-ast"sv) {
+      options.print_ast = true;
+    } else if (argv[arg] == "--dump-bytecode"sv) {
+      options.dump_bytecode = true;
+    } else if (argv[arg] == "--backend=ast"sv) {
+      options.backend = Backend::AST;
+    } else if (argv[arg] == "--backend=bytecode"sv) {
+      options.backend = Backend::BYTECODE;
+    } else if (argv[arg] == "--backend=jit"sv) {
+      options.backend = Backend::JIT;
+    } else {
+      break;
+    }
+  }
+
+  if (usage_error || (check ? arg == argc : argc - arg > 1)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--diagnostics=text|json] [--fold] [--node-count] "
+                 "[--print-ast] [--dump-bytecode] [--backend=ast|bytecode|jit] "
+                 "[--cache=DIR] [--stats[=json]] [--trace FILE] [script]\n"
+              << "       " << argv[0]
+              << " --check [--diagnostics=text|json] [--jobs=N] "
+                 "[--trace FILE] (script|directory)...\n";
     return EX_USAGE;
   }
 
-  Lox lox;
-  if (argc == 1) {
-    return lox.run_prompt();
+  if (trace_path != nullptr) {
+    Tracer::global().start();
+  }
+  Lox lox(options);
+  int status = 0;
+  if (check) {
+    status = lox.check_files(std::span(argv + arg, argv + argc));
+  } else if (arg == argc) {
+    status = lox.run_prompt();
+  } else {
+    status = lox.run_file(argv[arg]);
   }
 
-  return lox.run_file(argv[1]);
+  // the events are only written out now, so that writing them doesn't show
+  // in the trace
+  if (trace_path != nullptr) {
+    try {
+      Tracer::global().write(trace_path);
+    } catch (std::system_error const &error) {
+      std::cerr << "Could not write the trace: " << error.what() << '\n';
+      return EX_CANTCREAT;
+    }
+  }
+  return status;
 }
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "interner.hpp"
+#include "parallel_scanner.hpp"
+#include "scan_kernels.hpp"
+
+ParallelScanner::ParallelScanner(
+    std::string_view const source,
+    ThreadPool &pool,
+    std::size_t const chunk_size)
+    : m_source(source),
+      m_pool(pool),
+      m_chunk_size(std::max(chunk_size, std::size_t{1})) {
+  // tokens store their offsets in 32 bits
+  if (source.size() > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error("Sources larger than 4GiB are not supported");
+  }
+}
+
+ParallelScanner::ParallelScanner(
+    std::string_view const source,
+    ThreadPool &pool,
+    DiagnosticSink &diagnostics,
+    std::size_t const chunk_size)
+    : ParallelScanner(source, pool, chunk_size) {
+  m_diagnostics = &diagnostics;
+}
+
+TokenBuffer ParallelScanner::scan_tokens() {
+  auto const boundaries = chunk_boundaries();
+  auto const num_chunks = boundaries.size() - 1;
+
+  std::vector<std::optional<Chunk>> chunks(num_chunks);
+  m_pool.run(num_chunks, [&](std::size_t const idx) {
+    chunks[idx].emplace(scan_chunk(boundaries[idx], boundaries[idx + 1]));
+  });
+
+  // the speculation rarely fails, so the chunks give the final sizes
+  std::size_t num_tokens = 1;
+  std::size_t num_numbers = 0;
+  for (auto const &chunk : chunks) {
+    num_tokens += chunk->tokens.size();
+    num_numbers += chunk->tokens.number_count();
+  }
+  TokenBuffer tokens(m_source);
+  tokens.reserve(num_tokens, num_numbers);
+  LineTable lines;
+  std::vector<ScanError> errors;
+  // where the scan of the next chunk has to start, which is past its beginning
+  // when a string from an earlier chunk continues into it
+  std::size_t resume = 0;
+  for (std::size_t idx = 0; idx < num_chunks; ++idx) {
+    auto const begin = boundaries[idx];
+    auto const end = boundaries[idx + 1];
+    if (resume >= end) {
+      // the whole chunk is inside the string
+      continue;
+    }
+    if (resume > begin) {
+      // the chunk was scanned from the wrong state
+      chunks[idx].emplace(scan_chunk(resume, end));
+    }
+
+    auto &chunk = *chunks[idx];
+    tokens.append(chunk.tokens);
+    lines.append(chunk.lines);
+    errors.insert(errors.end(), chunk.errors.begin(), chunk.errors.end());
+    m_had_error = m_had_error || chunk.had_error;
+
+    resume = end;
+    if (chunk.open_string) {
+      resume = finish_string(*chunk.open_string, end, tokens, lines, errors);
+    }
+  }
+
+  tokens.push_back(
+      {TokenType::END_OF_FILE,
+       "",
+       static_cast<std::uint32_t>(m_source.size())});
+  auto const report = [&](DiagnosticSink &diagnostics) {
+    for (auto const &error : errors) {
+      diagnostics.report(error.code, lines, error.offset, error.length);
+    }
+  };
+  if (m_diagnostics != nullptr) {
+    report(*m_diagnostics);
+  } else if (!errors.empty()) {
+    // without a sink of the caller, the errors go to stderr in one write
+    DiagnosticSink diagnostics(m_source);
+    report(diagnostics);
+    diagnostics.flush(stderr);
+  }
+  tokens.set_lines(std::move(lines));
+  return tokens;
+}
+
+/// The offsets where the chunks begin, followed by the size of the source.
+/// Every chunk but the last ends right after a newline.
+std::vector<std::size_t> ParallelScanner::chunk_boundaries() const {
+  std::vector<std::size_t> boundaries{0};
+  std::size_t begin = 0;
+  while (m_source.size() - begin > m_chunk_size) {
+    auto const *const newline = static_cast<char const *>(std::memchr(
+        m_source.data() + begin + m_chunk_size - 1,
+        '\n',
+        m_source.size() - begin - m_chunk_size + 1));
+    if (newline == nullptr) {
+      break;
+    }
+    begin = static_cast<std::size_t>(newline - m_source.data()) + 1;
+    if (begin == m_source.size()) {
+      break;
+    }
+    boundaries.push_back(begin);
+  }
+  boundaries.push_back(m_source.size());
+  return boundaries;
+}
+
+ParallelScanner::Chunk
+ParallelScanner::scan_chunk(std::size_t const begin, std::size_t const end)
+    const {
+  TokenBuffer tokens(m_source);
+  std::vector<ScanError> errors;
+  Scanner scanner(m_source.substr(0, end), begin, errors);
+  for (auto token = scanner.next_token();
+       token.type() != TokenType::END_OF_FILE;
+       token = scanner.next_token()) {
+    tokens.push_back(token);
+  }
+  return {
+      std::move(tokens),
+      scanner.lines(),
+      std::move(errors),
+      scanner.m_open_string,
+      scanner.had_error()};
+}
+
+/// Finish the string that starts at `start` and is still open at `from`, the
+/// end of its chunk. Returns the offset right after the string.
+std::size_t ParallelScanner::finish_string(
+    std::uint32_t const start,
+    std::size_t const from,
+    TokenBuffer &tokens,
+    LineTable &lines,
+    std::vector<ScanError> &errors) {
+  auto const end = scan_kernels().find_string_end(m_source, from, lines);
+  if (end == m_source.size()) {
+    m_had_error = true;
+    errors.push_back(
+        {start,
+         static_cast<std::uint32_t>(m_source.size() - start),
+         DiagnosticCode::UNTERMINATED_STRING});
+    return end;
+  }
+
+  tokens.push_back(
+      {TokenType::STRING,
+       m_source.substr(start, end + 1 - start),
+       Interner::global().intern(m_source.substr(start + 1, end - start - 1)),
+       start});
+  return end + 1;
+}
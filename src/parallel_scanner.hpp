@@ -0,0 +1,73 @@
+#ifndef PARALLEL_SCANNER_HPP
+#define PARALLEL_SCANNER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "diagnostics.hpp"
+#include "line_table.hpp"
+#include "scanner.hpp"
+#include "thread_pool.hpp"
+#include "token_buffer.hpp"
+
+/// Scans large sources on a thread pool, producing exactly the tokens, lines
+/// and errors of `Scanner::scan_tokens()`.
+///
+/// The source is split into chunks that end right after a newline. No token
+/// crosses a newline, except for multi-line strings, and comments end at one,
+/// so each chunk is scanned speculatively as if it started between tokens.
+/// While stitching the chunks together in order, a string left open at the end
+/// of a chunk is finished in the following chunks, and a chunk that turns out
+/// to start inside that string is scanned again from where the string ends.
+class ParallelScanner {
+private:
+  std::string_view m_source;
+  ThreadPool &m_pool;
+  std::size_t m_chunk_size;
+  DiagnosticSink *m_diagnostics{}; // stderr if null
+  bool m_had_error{false};
+
+public:
+  static constexpr std::size_t default_chunk_size = std::size_t{1} << 20U;
+
+  ParallelScanner(
+      std::string_view source,
+      ThreadPool &pool,
+      std::size_t chunk_size = default_chunk_size);
+  ParallelScanner(
+      std::string_view source,
+      ThreadPool &pool,
+      DiagnosticSink &diagnostics,
+      std::size_t chunk_size = default_chunk_size);
+
+  /// Scan all the tokens, up to and including END_OF_FILE. Errors are reported
+  /// once all the chunks are scanned, in the order of the source, to the
+  /// diagnostics or else on stderr.
+  TokenBuffer scan_tokens();
+  [[nodiscard]] bool had_error() const {
+    return m_had_error;
+  }
+
+private:
+  struct Chunk {
+    TokenBuffer tokens;
+    LineTable lines;
+    std::vector<ScanError> errors;
+    std::optional<std::uint32_t> open_string;
+    bool had_error{false};
+  };
+
+  [[nodiscard]] std::vector<std::size_t> chunk_boundaries() const;
+  [[nodiscard]] Chunk scan_chunk(std::size_t begin, std::size_t end) const;
+  std::size_t finish_string(
+      std::uint32_t start,
+      std::size_t from,
+      TokenBuffer &tokens,
+      LineTable &lines,
+      std::vector<ScanError> &errors);
+};
+
+#endif // PARALLEL_SCANNER_HPP
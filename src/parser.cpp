@@ -1,7 +1,32 @@
+#include <cassert>
+
 #include "parser.hpp"
 
-ParseError parse_error(Token token, std::string_view message) {
-  error(token, message);
-  return {};
+std::optional<Ast> Parser::parse() {
+  assert(m_diagnostics != nullptr);
+  auto ast = parse_without_reporting();
+  for (auto const &[token, code] : m_errors) {
+    m_diagnostics->report(
+        code,
+        *m_lines,
+        token.offset(),
+        static_cast<std::uint32_t>(token.lexeme().size()),
+        token.type());
+  }
+  return ast;
 }
 
+std::optional<Ast> Parser::parse_without_reporting() {
+  // after an error, resynchronize and parse what follows, only to find the
+  // errors in it. Every attempt is a top-level expression in the trace.
+  auto parsed = traced_program();
+  while (!parsed && !is_at_end()) {
+    synchronize();
+    parsed = is_at_end() || traced_program();
+  }
+
+  if (!m_errors.empty()) {
+    return std::nullopt;
+  }
+  return std::move(m_ast);
+}
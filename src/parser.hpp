@@ -1,48 +1,144 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
-#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <utility>
 #include <vector>
 
-#include "error_message.hpp"
-#include "expr.hpp"
+#include "ast.hpp"
+#include "diagnostics.hpp"
+#include "scanner.hpp"
 #include "token.hpp"
+#include "token_cursor.hpp"
+#include "tracer.hpp"
 
 // Lox grammar
-// expression     → equality ;
-// equality       → comparison ( ( "!=" | "==" ) comparison )* ;
-// comparison     → term ( ( ">" | ">=" | "<" | "<=" ) term )* ;
-// term           → factor ( ( "-" | "+" ) factor )* ;
-// factor         → unary ( ( "/" | "*" ) unary )* ;
-// unary          → ( "!" | "-" ) unary
+// program        → expression EOF ;
+// expression     → prefix ( BINARY_OPERATOR expression )* ;
+// prefix         → ( "!" | "-" ) prefix
 //                | primary ;
 // primary        → NUMBER | STRING | "true" | "false" | "nil"
 //                | "(" expression ")" ;
+//
+// where the binary operators are parsed by precedence climbing, with the
+// precedence and associativity given by `binary_operators` below.
+
+/// From the loosest to the tightest binding
+enum class Precedence : std::uint8_t {
+  NONE, // not a binary operator
+  EQUALITY, // == !=
+  COMPARISON, // < <= > >=
+  TERM, // + -
+  FACTOR, // * /
+  PREFIX, // ! -, tighter than any binary operator
+};
 
-class ParseError : public std::exception {
-public:
-  [[nodiscard]] char const *what() const noexcept override {
-    return "ParseError";
-  }
+enum class Associativity : std::uint8_t {
+  LEFT,
+  RIGHT,
 };
 
-ParseError parse_error(Token token, std::string_view message);
+struct BinaryOperator {
+  TokenType type;
+  Precedence precedence;
+  Associativity associativity;
+};
+
+namespace detail {
+/// One row per binary operator
+inline constexpr std::array<BinaryOperator, 10> binary_operator_rows{{
+    {TokenType::BANG_EQUAL, Precedence::EQUALITY, Associativity::LEFT},
+    {TokenType::EQUAL_EQUAL, Precedence::EQUALITY, Associativity::LEFT},
+    {TokenType::GREATER, Precedence::COMPARISON, Associativity::LEFT},
+    {TokenType::GREATER_EQUAL, Precedence::COMPARISON, Associativity::LEFT},
+    {TokenType::LESS, Precedence::COMPARISON, Associativity::LEFT},
+    {TokenType::LESS_EQUAL, Precedence::COMPARISON, Associativity::LEFT},
+    {TokenType::MINUS, Precedence::TERM, Associativity::LEFT},
+    {TokenType::PLUS, Precedence::TERM, Associativity::LEFT},
+    {TokenType::SLASH, Precedence::FACTOR, Associativity::LEFT},
+    {TokenType::STAR, Precedence::FACTOR, Associativity::LEFT},
+}};
+} // namespace detail
+
+/// The binary operators, indexed by TokenType. Every other token has a NONE
+/// precedence, which ends an expression.
+inline constexpr auto binary_operators = [] {
+  std::array<BinaryOperator, num_token_types> table{};
+  for (std::size_t idx = 0; idx < table.size(); ++idx) {
+    table[idx] = {
+        static_cast<TokenType>(idx),
+        Precedence::NONE,
+        Associativity::LEFT};
+  }
+  for (auto const &row : detail::binary_operator_rows) {
+    table[static_cast<std::size_t>(row.type)] = row;
+  }
+  return table;
+}();
+
+/// A syntax error, at the token that the parser couldn't make sense of
+struct SyntaxError {
+  Token token;
+  DiagnosticCode code;
+};
 
+/// The result of parsing a part of the grammar: the index of its node, or
+/// nothing if there was a syntax error, which has already been recorded
+using ParseResult = std::optional<NodeIndex>;
+
+/// The parser pulls its tokens from the scanner as it goes, so it never needs
+/// the whole token stream in memory. The nodes go straight into a flat Ast.
+///
+/// Syntax errors don't unwind: every rule returns a ParseResult, and the
+/// parser never throws, so it also builds with -fno-exceptions. After an error
+/// the parser skips to the next statement boundary with `synchronize()` and
+/// goes on parsing from there, so one pass finds every error in the source.
 class Parser {
 private:
-  std::vector<Token> const &m_tokens;
-  std::size_t m_current_idx{};
+  TokenCursor m_tokens;
+  // where `parse()` reports the errors, null if they're only kept
+  LineTable const *m_lines{};
+  DiagnosticSink *m_diagnostics{};
+  Ast m_ast;
+  std::vector<SyntaxError> m_errors;
 
 public:
-  explicit Parser(std::vector<Token> const &tokens) : m_tokens{tokens} {}
+  /// A parser that reports its errors where the scanner does
+  explicit Parser(Scanner &scanner)
+      : m_tokens{scanner},
+        m_lines{&scanner.lines()},
+        m_diagnostics{&scanner.diagnostics()} {}
+
+  /// Parse the tokens [begin, end) of `tokens` as if they were the whole
+  /// source, whose lines are `lines`
+  Parser(
+      TokenBuffer const &tokens,
+      std::size_t const begin,
+      std::size_t const end,
+      LineTable const &lines,
+      DiagnosticSink &diagnostics)
+      : m_tokens{tokens, begin, end},
+        m_lines{&lines},
+        m_diagnostics{&diagnostics} {}
+
+  /// Parse the tokens [begin, end) of `tokens` as if they were the whole
+  /// source, only keeping the errors: this parser can't `parse()`, only
+  /// `parse_without_reporting()`
+  Parser(
+      TokenBuffer const &tokens,
+      std::size_t const begin,
+      std::size_t const end)
+      : m_tokens{tokens, begin, end} {}
 
 private:
   // non-consumers
-  [[nodiscard]] Token peek() const {
-    return m_tokens[m_current_idx];
+  [[nodiscard]] Token const &peek() const {
+    return m_tokens.peek();
   }
-  [[nodiscard]] Token previous() const {
-    return m_tokens[m_current_idx - 1];
+  [[nodiscard]] Token const &previous() const {
+    return m_tokens.previous();
   }
   [[nodiscard]] bool is_at_end() const {
     return peek().type() == TokenType::END_OF_FILE;
@@ -52,37 +148,46 @@ private:
   }
 
   // consumers
-  Token advance() {
+  Token const &advance() {
     if (!is_at_end()) {
-      ++m_current_idx;
+      m_tokens.advance();
     }
     return previous();
   }
 
-  bool match(TokenType type) {
+  /// Consume a token of the given type, or record an error if the next token
+  /// isn't one. Returns whether it was consumed.
+  bool consume(TokenType type, DiagnosticCode code) {
     if (check(type)) {
       advance();
       return true;
     }
+    static_cast<void>(error_at(peek(), code));
     return false;
   }
 
-  bool match(std::initializer_list<TokenType> types) {
-    if (std::ranges::any_of(types, [this](TokenType type) {
-          return check(type);
-        })) {
-      advance();
-      return true;
-    }
-    return false;
+  /// Record an error at `token`. Returns nothing, for the rule to return.
+  ParseResult error_at(Token const &token, DiagnosticCode const code) {
+    m_errors.push_back({token, code});
+    return std::nullopt;
   }
 
-  Token consume(TokenType type, std::string_view message) {
-    if (check(type)) {
-      return advance();
+  /// Parse an expression that must make up the rest of the source
+  bool program() {
+    if (!expression()) {
+      return false;
+    }
+    if (!is_at_end()) {
+      static_cast<void>(
+          error_at(peek(), DiagnosticCode::EXPECTED_END_OF_EXPRESSION));
+      return false;
     }
+    return true;
+  }
 
-    throw parse_error(peek(), message);
+  bool traced_program() {
+    TraceSpan const span("expression");
+    return program();
   }
 
   void synchronize() {
@@ -110,105 +215,105 @@ private:
   }
 
 public:
-  std::unique_ptr<Expr> parse() {
-    try {
-      return expression();
-    } catch (ParseError &error) {
-      fmt::println("{}", error.what());
-      return {};
-    }
-  }
-
-  std::unique_ptr<Expr> expression() {
-    return equality();
-  }
+  /// Parse the source, which must be a single expression. Returns its AST,
+  /// whose root is the last node, or nothing if there were syntax errors, which
+  /// are then all reported to the diagnostics, in the order of the source.
+  std::optional<Ast> parse();
 
-  std::unique_ptr<Expr> equality() {
-    auto expr = comparison();
+  /// Like `parse()`, but leave the errors in `errors()` without reporting them
+  std::optional<Ast> parse_without_reporting();
 
-    while (match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
-      auto op = previous();
-      auto right = comparison();
-      expr = std::make_unique<Binary>(expr.release(), op, right.release());
-    }
-
-    return expr;
+  /// The syntax errors found by `parse()`
+  [[nodiscard]] std::vector<SyntaxError> const &errors() const {
+    return m_errors;
   }
 
-  std::unique_ptr<Expr> comparison() {
-    auto expr = term();
-
-    while (match(
-        {TokenType::GREATER,
-         TokenType::GREATER_EQUAL,
-         TokenType::LESS,
-         TokenType::LESS_EQUAL})) {
-      auto op = previous();
-      auto right = term();
-      expr = std::make_unique<Binary>(expr.release(), op, right.release());
+  /// Parse an expression whose binary operators bind at least as tightly as
+  /// `min_precedence`
+  ParseResult
+  expression(Precedence const min_precedence = Precedence::EQUALITY) {
+    auto left = prefix();
+    if (!left) {
+      return left;
     }
 
-    return expr;
-  }
-
-  std::unique_ptr<Expr> term() {
-    auto expr = factor();
-
-    while (match({TokenType::MINUS, TokenType::PLUS})) {
-      auto op = previous();
-      auto right = factor();
-      expr = std::make_unique<Binary>(expr.release(), op, right.release());
-    }
-
-    return expr;
-  }
-
-  std::unique_ptr<Expr> factor() {
-    auto expr = unary();
+    while (true) {
+      auto const &oper =
+          binary_operators[static_cast<std::size_t>(peek().type())];
+      if (oper.precedence == Precedence::NONE
+          || oper.precedence < min_precedence) {
+        return left;
+      }
+      auto const offset = peek().offset();
+      advance();
 
-    while (match({TokenType::SLASH, TokenType::STAR})) {
-      auto op = previous();
-      auto right = unary();
-      expr = std::make_unique<Binary>(expr.release(), op, right.release());
+      // a left-associative operator takes only tighter operators on its right
+      auto const right_precedence = oper.associativity == Associativity::LEFT
+          ? static_cast<Precedence>(static_cast<int>(oper.precedence) + 1)
+          : oper.precedence;
+      auto const right = expression(right_precedence);
+      if (!right) {
+        return right;
+      }
+      left = m_ast.add_binary(oper.type, offset, *left, *right);
     }
-
-    return expr;
   }
 
-  std::unique_ptr<Expr> unary() {
-    if (match({TokenType::BANG, TokenType::MINUS})) {
-      auto op = previous();
-      auto right = unary();
-      return std::make_unique<Unary>(op, right.release());
+  ParseResult prefix() {
+    auto const type = peek().type();
+    if (type == TokenType::BANG || type == TokenType::MINUS) {
+      auto const offset = peek().offset();
+      advance();
+      auto const right = prefix();
+      if (!right) {
+        return right;
+      }
+      return m_ast.add_unary(type, offset, *right);
     }
 
     return primary();
   }
 
-  std::unique_ptr<Expr> primary() {
-    if (match(TokenType::FALSE)) {
-      return std::make_unique<BoolLiteral>(false);
+  ParseResult primary() {
+    auto const &token = peek();
+    switch (token.type()) {
+    case TokenType::FALSE: {
+      advance();
+      return m_ast.add_bool(previous().offset(), false);
     }
-    if (match(TokenType::TRUE)) {
-      return std::make_unique<BoolLiteral>(true);
+    case TokenType::TRUE: {
+      advance();
+      return m_ast.add_bool(previous().offset(), true);
     }
-    if (match(TokenType::NIL)) {
-      return std::make_unique<NilLiteral>();
+    case TokenType::NIL: {
+      advance();
+      return m_ast.add_nil(previous().offset());
     }
-    if (match(TokenType::NUMBER)) {
-      return std::make_unique<NumericLiteral>(*previous().literal<double>());
+    case TokenType::NUMBER: {
+      advance();
+      return m_ast.add_number(previous().offset(), previous().number());
     }
-    if (match(TokenType::STRING)) {
-      return std::make_unique<StringLiteral>(
-          *previous().literal<std::string>());
+    case TokenType::STRING: {
+      advance();
+      return m_ast.add_string(previous().offset(), previous().symbol());
+    }
+    case TokenType::LEFT_PAREN: {
+      auto const paren = advance();
+      auto const expr = expression();
+      if (!expr
+          || !consume(
+              TokenType::RIGHT_PAREN, DiagnosticCode::EXPECTED_RIGHT_PAREN)) {
+        return std::nullopt;
+      }
+      if (!m_ast.add_group(*expr)) {
+        return error_at(paren, DiagnosticCode::TOO_MANY_PARENTHESES);
+      }
+      return expr;
+    }
+    default: {
+      return error_at(token, DiagnosticCode::EXPECTED_EXPRESSION);
     }
-    if (match(TokenType::LEFT_PAREN)) {
-      auto expr = expression();
-      consume(TokenType::RIGHT_PAREN, "Exprected ')' after expression");
-      return std::make_unique<Grouping>(expr.release());
     }
-
-    throw parse_error(peek(), "Expected expression");
   }
 };
 
@@ -0,0 +1,226 @@
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+#include "scan_kernels.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CPPLOX_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace {
+enum class Run { LINE, STRING, WHITESPACE };
+
+constexpr bool is_whitespace(char const ch) {
+  return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+template <Run run>
+constexpr bool ends_run(char const ch) {
+  if constexpr (run == Run::LINE) {
+    return ch == '\n';
+  } else if constexpr (run == Run::STRING) {
+    return ch == '"';
+  } else {
+    return !is_whitespace(ch);
+  }
+}
+
+/// Stands in for the line table of the LINE kernels, which stop at the first
+/// newline and so never skip a line
+struct NoLines {
+  static void add_line(std::uint32_t /*start*/) {}
+};
+
+/// What the kernels for `run` record the lines they skip in
+template <Run run>
+using LinesFor = std::conditional_t<run == Run::LINE, NoLines, LineTable>;
+
+/// Record the lines that start after the newlines set in `newline_mask`, a bit
+/// mask of the newlines in the block of the source that starts at `pos`
+template <typename Lines>
+void add_lines(
+    Lines &lines,
+    std::size_t const pos,
+    std::uint32_t newline_mask) {
+  while (newline_mask != 0) {
+    auto const idx = static_cast<std::size_t>(std::countr_zero(newline_mask));
+    lines.add_line(static_cast<std::uint32_t>(pos + idx + 1));
+    newline_mask &= newline_mask - 1;
+  }
+}
+
+template <Run run>
+std::size_t scalar_scan(
+    std::string_view const source,
+    std::size_t pos,
+    LinesFor<run> &lines) {
+  while (pos < source.size() && !ends_run<run>(source[pos])) {
+    if constexpr (run != Run::LINE) {
+      if (source[pos] == '\n') {
+        lines.add_line(static_cast<std::uint32_t>(pos + 1));
+      }
+    }
+    ++pos;
+  }
+  return pos;
+}
+
+#ifdef CPPLOX_X86_SIMD
+/// Process `source` in blocks of 16 bytes, and let scalar_scan handle the tail
+template <Run run>
+__attribute__((target("sse2"))) std::size_t sse2_scan(
+    std::string_view const source,
+    std::size_t pos,
+    LinesFor<run> &lines) {
+  auto const newline = _mm_set1_epi8('\n');
+  for (; pos + 16 <= source.size(); pos += 16) {
+    auto const block = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(source.data() + pos));
+    auto const newlines = _mm_cmpeq_epi8(block, newline);
+
+    std::uint32_t end_mask{};
+    if constexpr (run == Run::LINE) {
+      end_mask = static_cast<std::uint32_t>(_mm_movemask_epi8(newlines));
+    } else if constexpr (run == Run::STRING) {
+      end_mask = static_cast<std::uint32_t>(
+          _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('"'))));
+    } else {
+      auto const spaces = _mm_or_si128(
+          _mm_or_si128(
+              _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+              _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))),
+          _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\r')), newlines));
+      end_mask = ~static_cast<std::uint32_t>(_mm_movemask_epi8(spaces)) & 0xFFFF;
+    }
+
+    auto newline_mask = std::uint32_t{};
+    if constexpr (run != Run::LINE) {
+      newline_mask = static_cast<std::uint32_t>(_mm_movemask_epi8(newlines));
+    }
+    if (end_mask != 0) {
+      auto const idx = std::countr_zero(end_mask);
+      if constexpr (run != Run::LINE) {
+        add_lines(lines, pos, newline_mask & ((1U << idx) - 1));
+      }
+      return pos + static_cast<std::size_t>(idx);
+    }
+    add_lines(lines, pos, newline_mask);
+  }
+  return scalar_scan<run>(source, pos, lines);
+}
+
+/// Process `source` in blocks of 32 bytes, and let sse2_scan handle the tail
+template <Run run>
+__attribute__((target("avx2"))) std::size_t avx2_scan(
+    std::string_view const source,
+    std::size_t pos,
+    LinesFor<run> &lines) {
+  auto const newline = _mm256_set1_epi8('\n');
+  for (; pos + 32 <= source.size(); pos += 32) {
+    auto const block = _mm256_loadu_si256(
+        reinterpret_cast<__m256i const *>(source.data() + pos));
+    auto const newlines = _mm256_cmpeq_epi8(block, newline);
+
+    std::uint32_t end_mask{};
+    if constexpr (run == Run::LINE) {
+      end_mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(newlines));
+    } else if constexpr (run == Run::STRING) {
+      end_mask = static_cast<std::uint32_t>(
+          _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('"'))));
+    } else {
+      auto const spaces = _mm256_or_si256(
+          _mm256_or_si256(
+              _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')),
+              _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))),
+          _mm256_or_si256(
+              _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r')),
+              newlines));
+      end_mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(spaces));
+    }
+
+    auto newline_mask = std::uint32_t{};
+    if constexpr (run != Run::LINE) {
+      newline_mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(newlines));
+    }
+    if (end_mask != 0) {
+      auto const idx = std::countr_zero(end_mask);
+      if constexpr (run != Run::LINE) {
+        add_lines(lines, pos, newline_mask & ((1U << idx) - 1));
+      }
+      return pos + static_cast<std::size_t>(idx);
+    }
+    add_lines(lines, pos, newline_mask);
+  }
+  return sse2_scan<run>(source, pos, lines);
+}
+#endif
+
+/// Adapt a LINE kernel to the signature of find_line_end
+template <auto scan>
+std::size_t find_line_end(std::string_view const source, std::size_t pos) {
+  NoLines lines;
+  return scan(source, pos, lines);
+}
+
+constexpr ScanKernels scalar_kernels{
+    find_line_end<scalar_scan<Run::LINE>>,
+    scalar_scan<Run::STRING>,
+    scalar_scan<Run::WHITESPACE>};
+
+#ifdef CPPLOX_X86_SIMD
+constexpr ScanKernels sse2_kernels{
+    find_line_end<sse2_scan<Run::LINE>>,
+    sse2_scan<Run::STRING>,
+    sse2_scan<Run::WHITESPACE>};
+
+constexpr ScanKernels avx2_kernels{
+    find_line_end<avx2_scan<Run::LINE>>,
+    avx2_scan<Run::STRING>,
+    avx2_scan<Run::WHITESPACE>};
+#endif
+
+ScanKernels const &kernels_for(SimdLevel const level) {
+  switch (level) {
+#ifdef CPPLOX_X86_SIMD
+  case SimdLevel::AVX2: {
+    return avx2_kernels;
+  }
+  case SimdLevel::SSE2: {
+    return sse2_kernels;
+  }
+#endif
+  default: {
+    return scalar_kernels;
+  }
+  }
+}
+
+std::atomic<ScanKernels const *> current_kernels{
+    &kernels_for(best_simd_level())};
+} // namespace
+
+SimdLevel best_simd_level() {
+#ifdef CPPLOX_X86_SIMD
+  // we may be called during static initialization
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  // SSE2 is part of the x86-64 baseline
+  return SimdLevel::SSE2;
+#else
+  return SimdLevel::SCALAR;
+#endif
+}
+
+void use_simd_level(SimdLevel const level) {
+  auto const best = best_simd_level();
+  current_kernels.store(&kernels_for(level > best ? best : level));
+}
+
+ScanKernels const &scan_kernels() {
+  return *current_kernels.load();
+}
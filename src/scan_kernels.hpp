@@ -0,0 +1,45 @@
+#ifndef SCAN_KERNELS_HPP
+#define SCAN_KERNELS_HPP
+
+#include <cstddef>
+#include <string_view>
+
+#include "line_table.hpp"
+
+/// The scanner spends most of its time skipping over bytes that don't start a
+/// token: whitespace, comments and the bodies of string literals. The scan
+/// kernels find the end of such runs many bytes at a time, while recording the
+/// lines that start in the bytes they skip.
+///
+/// Every kernel starts looking at `pos` and returns the index of the first byte
+/// that ends the run, or `source.size()` if there's none.
+struct ScanKernels {
+  /// Find the next '\n'
+  std::size_t (*find_line_end)(std::string_view source, std::size_t pos);
+  /// Find the next '"', adding the lines skipped to `lines`
+  std::size_t (*find_string_end)(
+      std::string_view source,
+      std::size_t pos,
+      LineTable &lines);
+  /// Find the next byte that isn't one of " \t\r\n", adding the lines
+  /// skipped to `lines`
+  std::size_t (*skip_whitespace)(
+      std::string_view source,
+      std::size_t pos,
+      LineTable &lines);
+};
+
+enum class SimdLevel { SCALAR, SSE2, AVX2 };
+
+/// The best SIMD level supported by both the build and the running CPU
+SimdLevel best_simd_level();
+
+/// Select the kernels used by the scanners created from now on. By default
+/// these are the kernels of `best_simd_level()`. Levels higher than that fall
+/// back to the best one.
+void use_simd_level(SimdLevel level);
+
+/// The kernels for the currently selected SIMD level
+ScanKernels const &scan_kernels();
+
+#endif // SCAN_KERNELS_HPP
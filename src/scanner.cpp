@@ -1,208 +1,357 @@
 #include "scanner.hpp"
-#include "error_message.hpp"
 #include "token_type.hpp"
 
+#include <array>
 #include <charconv>
-#include <unordered_map>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 
-constexpr bool isdigit(char const ch) {
-  return ch >= '0' && ch <= '9';
-}
+namespace {
+/// Every byte of the source belongs to one character class, and the lexer
+/// only ever looks at the classes
+enum CharClass : std::uint8_t {
+  OTHER, // not valid outside of strings and comments
+  SPACE, // ' ', '\t', '\r', '\n'
+  SINGLE, // a one-character token other than '.', see single_char_types
+  DIGIT,
+  ALPHA, // letters and '_'
+  DOT,
+  QUOTE,
+  SLASH,
+  BANG,
+  EQUAL,
+  LESS,
+  GREATER,
+  END, // past the end of the source
+  NUM_CLASSES
+};
+
+constexpr auto char_classes = [] {
+  std::array<CharClass, 256> classes{};
+  for (unsigned ch = '0'; ch <= '9'; ++ch) {
+    classes[ch] = DIGIT;
+  }
+  for (unsigned ch = 'a'; ch <= 'z'; ++ch) {
+    classes[ch] = ALPHA;
+    classes[ch - 'a' + 'A'] = ALPHA;
+  }
+  classes['_'] = ALPHA;
+  for (char ch : {' ', '\t', '\r', '\n'}) {
+    classes[static_cast<unsigned char>(ch)] = SPACE;
+  }
+  for (char ch : {'(', ')', '{', '}', ',', '-', '+', ';', '*'}) {
+    classes[static_cast<unsigned char>(ch)] = SINGLE;
+  }
+  classes['.'] = DOT;
+  classes['"'] = QUOTE;
+  classes['/'] = SLASH;
+  classes['!'] = BANG;
+  classes['='] = EQUAL;
+  classes['<'] = LESS;
+  classes['>'] = GREATER;
+  return classes;
+}();
+
+constexpr auto single_char_types = [] {
+  std::array<TokenType, 256> types{};
+  types['('] = TokenType::LEFT_PAREN;
+  types[')'] = TokenType::RIGHT_PAREN;
+  types['{'] = TokenType::LEFT_BRACE;
+  types['}'] = TokenType::RIGHT_BRACE;
+  types[','] = TokenType::COMMA;
+  types['-'] = TokenType::MINUS;
+  types['+'] = TokenType::PLUS;
+  types[';'] = TokenType::SEMICOLON;
+  types['*'] = TokenType::STAR;
+  types['.'] = TokenType::DOT;
+  return types;
+}();
+
+/// The states of the lexer DFA, followed by the actions that end a token. A
+/// transition either moves to another state, consuming the current byte, or
+/// performs an action.
+enum Transition : std::uint8_t {
+  // states
+  START,
+  IN_BANG,
+  IN_EQUAL,
+  IN_LESS,
+  IN_GREATER,
+  IN_SLASH,
+  IN_NUMBER,
+  IN_NUMBER_DOT, // a '.' after the integer part, may start a fraction
+  IN_FRACTION,
+  IN_IDENTIFIER,
+  NUM_STATES,
+
+  // actions
+  SKIP_WHITESPACE = NUM_STATES,
+  SKIP_COMMENT, // consume the second '/' and skip to the end of the line
+  EMIT_SINGLE, // consume the byte and emit its one-character token
+  EMIT_OPERATOR, // emit the operator of the state without the current byte
+  EMIT_OPERATOR_EQUAL, // consume the '=' and emit the two-character operator
+  EMIT_STRING,
+  EMIT_NUMBER,
+  EMIT_NUMBER_BEFORE_DOT, // un-consume the '.' and emit the integer
+  EMIT_IDENTIFIER,
+  EMIT_ERROR, // consume the byte and report it
+};
+
+constexpr auto transitions = [] {
+  std::array<std::array<Transition, NUM_CLASSES>, NUM_STATES> table{};
+
+  auto &start = table[START];
+  start.fill(EMIT_ERROR);
+  start[SPACE] = SKIP_WHITESPACE;
+  start[SINGLE] = EMIT_SINGLE;
+  start[DIGIT] = IN_NUMBER;
+  start[ALPHA] = IN_IDENTIFIER;
+  start[DOT] = EMIT_SINGLE;
+  start[QUOTE] = EMIT_STRING;
+  start[SLASH] = IN_SLASH;
+  start[BANG] = IN_BANG;
+  start[EQUAL] = IN_EQUAL;
+  start[LESS] = IN_LESS;
+  start[GREATER] = IN_GREATER;
+
+  for (auto state : {IN_BANG, IN_EQUAL, IN_LESS, IN_GREATER}) {
+    table[state].fill(EMIT_OPERATOR);
+    table[state][EQUAL] = EMIT_OPERATOR_EQUAL;
+  }
 
-constexpr bool isalpha(char const ch) {
-  return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || ch == '_';
+  table[IN_SLASH].fill(EMIT_OPERATOR);
+  table[IN_SLASH][SLASH] = SKIP_COMMENT;
+
+  table[IN_NUMBER].fill(EMIT_NUMBER);
+  table[IN_NUMBER][DIGIT] = IN_NUMBER;
+  table[IN_NUMBER][DOT] = IN_NUMBER_DOT;
+
+  table[IN_NUMBER_DOT].fill(EMIT_NUMBER_BEFORE_DOT);
+  table[IN_NUMBER_DOT][DIGIT] = IN_FRACTION;
+
+  table[IN_FRACTION].fill(EMIT_NUMBER);
+  table[IN_FRACTION][DIGIT] = IN_FRACTION;
+
+  table[IN_IDENTIFIER].fill(EMIT_IDENTIFIER);
+  table[IN_IDENTIFIER][ALPHA] = IN_IDENTIFIER;
+  table[IN_IDENTIFIER][DIGIT] = IN_IDENTIFIER;
+
+  return table;
+}();
+
+/// The operator emitted by EMIT_OPERATOR in each state. EMIT_OPERATOR_EQUAL
+/// emits the next token type, e.g. BANG_EQUAL instead of BANG.
+constexpr auto state_operators = [] {
+  std::array<TokenType, NUM_STATES> types{};
+  types[IN_BANG] = TokenType::BANG;
+  types[IN_EQUAL] = TokenType::EQUAL;
+  types[IN_LESS] = TokenType::LESS;
+  types[IN_GREATER] = TokenType::GREATER;
+  types[IN_SLASH] = TokenType::SLASH;
+  return types;
+}();
+
+static_assert(
+    static_cast<int>(TokenType::BANG_EQUAL)
+            == static_cast<int>(TokenType::BANG) + 1
+        && static_cast<int>(TokenType::EQUAL_EQUAL)
+            == static_cast<int>(TokenType::EQUAL) + 1
+        && static_cast<int>(TokenType::LESS_EQUAL)
+            == static_cast<int>(TokenType::LESS) + 1
+        && static_cast<int>(TokenType::GREATER_EQUAL)
+            == static_cast<int>(TokenType::GREATER) + 1,
+    "EMIT_OPERATOR_EQUAL relies on the X, X_EQUAL order of TokenType");
+} // namespace
+
+Scanner::Scanner(std::string_view const source)
+    : Scanner(source, nullptr) {
+  m_own_diagnostics.emplace(source, stderr);
 }
 
-constexpr bool isalnum(char const ch) {
-  return isdigit(ch) || isalpha(ch);
+Scanner::Scanner(
+    std::string_view const source,
+    DiagnosticSink &diagnostics)
+    : Scanner(source, &diagnostics) {}
+
+Scanner::Scanner(
+    std::string_view const source,
+    DiagnosticSink *const diagnostics)
+    : m_source(source),
+      m_diagnostics(diagnostics) {
+  // tokens store their offsets in 32 bits
+  if (source.size() > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error("Sources larger than 4GiB are not supported");
+  }
 }
 
-std::vector<Token> Scanner::scan_tokens() {
-  while (!is_at_end()) {
+Token Scanner::next_token() {
+  m_token.reset();
+  while (!m_token && !is_at_end()) {
     m_start_idx = m_current_idx;
     scan_token();
   }
 
-  m_tokens.emplace_back(TokenType::END_OF_FILE, "", nullptr, m_current_line);
-  return std::move(m_tokens);
+  if (!m_token) {
+    return {
+        TokenType::END_OF_FILE,
+        "",
+        static_cast<std::uint32_t>(m_source.size())};
+  }
+  return *m_token;
 }
 
-void Scanner::add_string_token() {
-  std::size_t lines_to_advance = 0;
-  while (peek() != '"' && !is_at_end()) {
-    // we allow string literals spanning multiple lines
-    if (advance() == '\n') {
-      ++lines_to_advance;
-    }
+TokenBuffer Scanner::scan_tokens() {
+  TokenBuffer tokens(m_source);
+  Token token;
+  do {
+    token = next_token();
+    tokens.push_back(token);
+  } while (token.type() != TokenType::END_OF_FILE);
+  // we keep our own copy, to report errors on lines of the source
+  tokens.set_lines(m_lines);
+  return tokens;
+}
+
+void Scanner::scan_error(DiagnosticCode const code, std::size_t const length) {
+  m_had_error = true;
+  auto const offset = static_cast<std::uint32_t>(m_start_idx);
+  if (m_deferred_errors != nullptr) {
+    m_deferred_errors->push_back(
+        {offset, static_cast<std::uint32_t>(length), code});
+  } else {
+    diagnostics().report(
+        code,
+        m_lines,
+        offset,
+        static_cast<std::uint32_t>(length));
   }
+}
+
+void Scanner::add_string_token() {
+  // we allow string literals spanning multiple lines
+  m_current_idx = m_kernels.find_string_end(m_source, m_current_idx, m_lines);
 
   if (is_at_end()) {
-    m_had_error = true;
-    report(
-        m_current_line,
-        "Unterminated string",
-        m_source.substr(m_start_idx, m_current_idx - m_start_idx));
+    if (m_deferred_errors != nullptr) {
+      // the string may well end in a later chunk
+      m_open_string = static_cast<std::uint32_t>(m_start_idx);
+      return;
+    }
+    scan_error(
+        DiagnosticCode::UNTERMINATED_STRING,
+        m_current_idx - m_start_idx);
     return;
   }
 
   // the closing "
   advance();
 
-  auto *str = new std::string(
-      m_source.data() + m_start_idx + 1,
-      m_current_idx - m_start_idx - 2);
-  add_token(TokenType::STRING, str);
-  m_current_line += lines_to_advance;
+  add_token(
+      TokenType::STRING,
+      m_source.substr(m_start_idx + 1, m_current_idx - m_start_idx - 2));
 }
 
 void Scanner::add_number_token() {
-  while (isdigit(peek())) {
-    advance();
-  }
-
-  // look for a fractional part
-  if (peek() == '.' && isdigit(peek_next())) {
-    // consume the '.'
-    advance();
-
-    while (isdigit(peek())) {
-      advance();
-    }
-  }
-
-  auto *value = new double();
+  double value{};
   std::from_chars(
       m_source.data() + m_start_idx,
       m_source.data() + m_current_idx,
-      *value);
+      value);
   add_token(TokenType::NUMBER, value);
 }
 
 void Scanner::add_identifier_token() {
-  static const std::unordered_map<std::string_view, TokenType> reserved_words(
-      {{"and", TokenType::AND},
-       {"class", TokenType::CLASS},
-       {"else", TokenType::ELSE},
-       {"false", TokenType::FALSE},
-       {"for", TokenType::FOR},
-       {"fun", TokenType::FUN},
-       {"if", TokenType::IF},
-       {"nil", TokenType::NIL},
-       {"or", TokenType::OR},
-       {"print", TokenType::PRINT},
-       {"return", TokenType::RETURN},
-       {"super", TokenType::SUPER},
-       {"this", TokenType::THIS},
-       {"true", TokenType::TRUE},
-       {"var", TokenType::VAR},
-       {"while", TokenType::WHILE}});
-
-  while (isalnum(peek())) {
-    advance();
-  }
-
   auto identifier = m_source.substr(m_start_idx, m_current_idx - m_start_idx);
-  if (auto it = reserved_words.find(identifier); it != reserved_words.end()) {
+  if (auto type = keyword_type(identifier); type != TokenType::IDENTIFIER) {
     // found reserved word
-    add_token(it->second);
+    add_token(type);
   } else {
     // it's not a reserved word so it's an identifier
-    add_token(TokenType::IDENTIFIER, new std::string(identifier));
+    add_token(TokenType::IDENTIFIER, identifier);
   }
 }
 
+/// Run the lexer DFA from m_start_idx until it adds one token, reports an
+/// invalid character or reaches the end of the source. Whitespace and comments
+/// are skipped without leaving the loop.
 void Scanner::scan_token() {
-  char ch = advance();
-  if (ch == ' ' || ch == '\r' || ch == '\t') {
-    return;
-  }
-  if (ch == '\n') {
-    ++m_current_line;
-    return;
-  }
-  if (ch == '(') {
-    add_token(TokenType::LEFT_PAREN);
-    return;
-  }
-  if (ch == ')') {
-    add_token(TokenType::RIGHT_PAREN);
-    return;
-  }
-  if (ch == '{') {
-    add_token(TokenType::LEFT_BRACE);
-    return;
-  }
-  if (ch == '}') {
-    add_token(TokenType::RIGHT_BRACE);
-    return;
-  }
-  if (ch == ',') {
-    add_token(TokenType::COMMA);
-    return;
-  }
-  if (ch == '.') {
-    add_token(TokenType::DOT);
-    return;
-  }
-  if (ch == '-') {
-    add_token(TokenType::MINUS);
-    return;
-  }
-  if (ch == '+') {
-    add_token(TokenType::PLUS);
-    return;
-  }
-  if (ch == ';') {
-    add_token(TokenType::SEMICOLON);
-    return;
-  }
-  if (ch == '*') {
-    add_token(TokenType::STAR);
-    return;
-  }
-  if (ch == '!') {
-    add_token(match('=') ? TokenType::BANG_EQUAL : TokenType::BANG);
-    return;
-  }
-  if (ch == '=') {
-    add_token(match('=') ? TokenType::EQUAL_EQUAL : TokenType::EQUAL);
-    return;
-  }
-  if (ch == '<') {
-    add_token(match('=') ? TokenType::LESS_EQUAL : TokenType::LESS);
-    return;
-  }
-  if (ch == '>') {
-    add_token(match('=') ? TokenType::GREATER_EQUAL : TokenType::GREATER);
-    return;
-  }
-  if (ch == '/') {
-    if (match('/')) {
-      // we're in a comment line, so advance till the end of the line
-      while (peek() != '\n' && !is_at_end()) {
-        advance();
+  Transition state = START;
+  while (true) {
+    auto const cls = is_at_end()
+        ? END
+        : char_classes[static_cast<unsigned char>(m_source[m_current_idx])];
+    auto const transition = transitions[state][cls];
+    if (transition < NUM_STATES) {
+      state = transition;
+      ++m_current_idx;
+      continue;
+    }
+
+    switch (transition) {
+    // the skipping actions don't end the scan, unless they reach the end
+    case SKIP_WHITESPACE: {
+      // whitespace between tokens is mostly a single space, so only call the
+      // kernel for longer runs
+      if (m_source[m_current_idx++] == '\n') {
+        m_lines.add_line(static_cast<std::uint32_t>(m_current_idx));
+      }
+      if (!is_at_end()
+          && char_classes[static_cast<unsigned char>(m_source[m_current_idx])]
+              == SPACE) {
+        m_current_idx =
+            m_kernels.skip_whitespace(m_source, m_current_idx, m_lines);
       }
-    } else {
-      add_token(TokenType::SLASH);
+      break;
+    }
+    case SKIP_COMMENT: {
+      m_current_idx = m_kernels.find_line_end(m_source, m_current_idx + 1);
+      break;
+    }
+    case EMIT_SINGLE: {
+      auto const ch = static_cast<unsigned char>(m_source[m_current_idx++]);
+      add_token(single_char_types[ch]);
+      return;
+    }
+    case EMIT_OPERATOR: {
+      add_token(state_operators[state]);
+      return;
+    }
+    case EMIT_OPERATOR_EQUAL: {
+      ++m_current_idx;
+      add_token(static_cast<TokenType>(
+          static_cast<int>(state_operators[state]) + 1));
+      return;
+    }
+    case EMIT_STRING: {
+      ++m_current_idx;
+      add_string_token();
+      return;
+    }
+    case EMIT_NUMBER_BEFORE_DOT: {
+      --m_current_idx;
+      add_number_token();
+      return;
+    }
+    case EMIT_NUMBER: {
+      add_number_token();
+      return;
+    }
+    case EMIT_IDENTIFIER: {
+      add_identifier_token();
+      return;
+    }
+    default: {
+      ++m_current_idx;
+      scan_error(DiagnosticCode::UNEXPECTED_CHARACTER, 1);
+      return;
+    }
     }
-    return;
-  }
-  if (ch == '"') {
-    add_string_token();
-    return;
-  }
-  if (isdigit(ch)) {
-    add_number_token();
-    return;
-  }
-  if (isalpha(ch)) {
-    add_identifier_token();
-    return;
-  }
 
-  m_had_error = true;
-  report(
-      m_current_line,
-      "Unexpected character",
-      m_source.substr(m_start_idx, 1));
+    if (is_at_end()) {
+      return;
+    }
+    m_start_idx = m_current_idx;
+    state = START;
+  }
 }
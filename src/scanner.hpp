@@ -1,9 +1,25 @@
 #ifndef SCANNER_HPP
 #define SCANNER_HPP
 
+#include <cstdint>
+#include <optional>
+#include <string_view>
 #include <vector>
 
+#include "diagnostics.hpp"
+#include "interner.hpp"
+#include "line_table.hpp"
+#include "scan_kernels.hpp"
 #include "token.hpp"
+#include "token_buffer.hpp"
+
+/// An error found while scanning a chunk, to be reported once the chunks are
+/// stitched together and the lines of the source are known
+struct ScanError {
+  std::uint32_t offset;
+  std::uint32_t length; // of the text it's about
+  DiagnosticCode code;
+};
 
 /// The scanner scans the source code, separates it into lexemes, and turns the
 /// lexemes into tokens.
@@ -12,23 +28,67 @@
 /// process of grouping character sequences into lexemes, we also stumble upon
 /// some other useful information. When we take the lexeme and bundle it
 /// together with that other data, the result is a token
+///
+/// Tokens are produced on demand by `next_token()`, so a consumer that doesn't
+/// need them all at once (like the Parser, through a TokenCursor) never has to
+/// hold more than a few of them in memory.
 class Scanner {
 private:
   std::string_view m_source;
-  std::size_t m_current_line{1}; // current line in m_source
+  LineTable m_lines; // the lines of m_source scanned so far
   std::size_t m_start_idx{}; // index in m_source where the current lexeme begun
   std::size_t m_current_idx{}; // current index in m_source
-  std::vector<Token> m_tokens;
+  std::optional<Token> m_token; // the token added by the last scan_token()
   bool m_had_error{false};
+  ScanKernels const &m_kernels{scan_kernels()};
+  DiagnosticSink *m_diagnostics; // null when the scanner has its own
+  // only set when the scanner reports its own errors
+  std::optional<DiagnosticSink> m_own_diagnostics;
+  // only set when scanning a chunk for the ParallelScanner
+  std::vector<ScanError> *m_deferred_errors{};
+  std::optional<std::uint32_t> m_open_string; // a string still open at the end
+
+  friend class ParallelScanner;
+  friend class Document;
 
 public:
-  explicit Scanner(char const *source) : m_source(source) {}
-  std::vector<Token> scan_tokens();
+  /// A scanner that reports its errors on stderr as soon as it finds them
+  explicit Scanner(std::string_view source);
+  /// A scanner that reports its errors to `diagnostics`
+  Scanner(std::string_view source, DiagnosticSink &diagnostics);
+  /// Scan and return the next token. Once the source is exhausted, every call
+  /// returns an END_OF_FILE token.
+  Token next_token();
+  /// Scan all the remaining tokens, up to and including END_OF_FILE
+  TokenBuffer scan_tokens();
+  /// The lines of the source scanned so far, to look up the lines of tokens
+  [[nodiscard]] LineTable const &lines() const {
+    return m_lines;
+  }
   [[nodiscard]] bool had_error() const {
     return m_had_error;
   }
+  /// Where the errors of the source are reported, by the Parser too
+  [[nodiscard]] DiagnosticSink &diagnostics() {
+    return m_diagnostics != nullptr ? *m_diagnostics : *m_own_diagnostics;
+  }
 
 private:
+  Scanner(std::string_view source, DiagnosticSink *diagnostics);
+
+  /// Scan the chunk of `source` starting at `begin`, where `source` ends at the
+  /// end of the chunk. Errors are recorded in `errors` instead of reported, and
+  /// a string that's still open at the end of the chunk is recorded in
+  /// m_open_string, to be finished by the caller.
+  Scanner(
+      std::string_view const source,
+      std::size_t const begin,
+      std::vector<ScanError> &errors)
+      : Scanner(source, nullptr) {
+    m_current_idx = begin;
+    m_deferred_errors = &errors;
+  }
+
   [[nodiscard]] bool is_at_end() const {
     return m_current_idx >= m_source.size();
   }
@@ -38,43 +98,29 @@ private:
     return m_source[m_current_idx++];
   }
 
-  /// match() is like a conditional advance()
-  /// If the next character is the expected one consume it and return true;
-  /// otherwise return false without consuming it
-  bool match(char expected) {
-    if (is_at_end() || m_source[m_current_idx] != expected) {
-      return false;
-    }
+  void scan_error(DiagnosticCode code, std::size_t length);
 
-    ++m_current_idx;
-    return true;
-  }
-
-  /// Return the next character without consuming it (lookahead)
-  [[nodiscard]] char peek() const {
-    if (m_current_idx >= m_source.size()) {
-      return '\0';
-    }
-    return m_source[m_current_idx];
-  }
-
-  [[nodiscard]] char peek_next() const {
-    if (m_current_idx + 1 >= m_source.size()) {
-      return '\0';
-    }
-    return m_source[m_current_idx + 1];
+  void add_token(TokenType type) {
+    m_token.emplace(
+        type,
+        m_source.substr(m_start_idx, m_current_idx - m_start_idx),
+        static_cast<std::uint32_t>(m_start_idx));
   }
 
-  void add_token(TokenType type) {
-    add_token(type, nullptr);
+  void add_token(TokenType type, double number) {
+    m_token.emplace(
+        type,
+        m_source.substr(m_start_idx, m_current_idx - m_start_idx),
+        number,
+        static_cast<std::uint32_t>(m_start_idx));
   }
 
-  void add_token(TokenType type, void *literal) {
-    m_tokens.emplace_back(
+  void add_token(TokenType type, std::string_view text) {
+    m_token.emplace(
         type,
         m_source.substr(m_start_idx, m_current_idx - m_start_idx),
-        literal,
-        m_current_line);
+        Interner::global().intern(text),
+        static_cast<std::uint32_t>(m_start_idx));
   }
 
   void add_string_token();
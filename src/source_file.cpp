@@ -0,0 +1,97 @@
+#include <cerrno>
+#include <fcntl.h> // open
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <system_error>
+#include <unistd.h> // read, close
+
+#include "source_file.hpp"
+
+namespace {
+[[noreturn]] void throw_errno(int const err, char const *path) {
+  throw std::system_error(err, std::generic_category(), path);
+}
+
+/// Closes the file descriptor when going out of scope
+class FileDescriptor {
+  int m_fd;
+
+public:
+  explicit FileDescriptor(int const fd) : m_fd(fd) {}
+  ~FileDescriptor() {
+    close(m_fd);
+  }
+  FileDescriptor(FileDescriptor const &) = delete;
+  FileDescriptor &operator=(FileDescriptor const &) = delete;
+
+  [[nodiscard]] int get() const {
+    return m_fd;
+  }
+};
+} // namespace
+
+SourceFile::SourceFile(char const *path) {
+  FileDescriptor const fd(open(path, O_RDONLY | O_CLOEXEC));
+  if (fd.get() == -1) {
+    throw_errno(errno, path);
+  }
+
+  struct stat st {};
+  if (fstat(fd.get(), &st) == -1) {
+    throw_errno(errno, path);
+  }
+  if (S_ISDIR(st.st_mode)) {
+    throw_errno(EISDIR, path);
+  }
+
+  auto const size = static_cast<std::size_t>(st.st_size);
+  if (S_ISREG(st.st_mode) && size > 0) {
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (mapping != MAP_FAILED) {
+      // the scanner reads the file front to back
+      madvise(mapping, size, MADV_SEQUENTIAL);
+      m_mapping = mapping;
+      m_contents = {static_cast<char const *>(mapping), size};
+      return;
+    }
+    // some file systems don't support mmap, so fall back to reading
+  }
+
+  read_all(fd.get(), size, path);
+  m_contents = m_buffer;
+}
+
+SourceFile::~SourceFile() {
+  if (m_mapping != nullptr) {
+    munmap(m_mapping, m_contents.size());
+  }
+}
+
+/// Read from `fd` until EOF. `size_hint` is the expected size of the file, or
+/// zero if it's not known.
+void SourceFile::read_all(
+    int const fd,
+    std::size_t const size_hint,
+    char const *path) {
+  static constexpr std::size_t chunk_size = 64 * 1024;
+
+  m_buffer.resize(size_hint + chunk_size);
+  std::size_t used = 0;
+  while (true) {
+    if (used == m_buffer.size()) {
+      m_buffer.resize(m_buffer.size() * 2);
+    }
+    auto const count = read(fd, m_buffer.data() + used, m_buffer.size() - used);
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw_errno(errno, path);
+    }
+    if (count == 0) {
+      break;
+    }
+    used += static_cast<std::size_t>(count);
+  }
+  m_buffer.resize(used);
+}
@@ -0,0 +1,38 @@
+#ifndef SOURCE_FILE_HPP
+#define SOURCE_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/// The read-only contents of a script file.
+///
+/// Regular files are memory-mapped, so their contents are never copied. Files
+/// that can't be mapped (pipes, character devices, ...) are read into a
+/// buffer instead. The contents may contain NUL bytes; use their size rather
+/// than looking for a terminator.
+///
+/// Throws std::system_error if the file can't be opened or read.
+class SourceFile {
+private:
+  std::string_view m_contents;
+  void *m_mapping{}; // non-null if the contents are mapped
+  std::string m_buffer; // holds the contents if they aren't mapped
+
+public:
+  explicit SourceFile(char const *path);
+  ~SourceFile();
+
+  // m_contents may point into m_buffer, so we can't be copied or moved
+  SourceFile(SourceFile const &) = delete;
+  SourceFile &operator=(SourceFile const &) = delete;
+
+  [[nodiscard]] std::string_view contents() const {
+    return m_contents;
+  }
+
+private:
+  void read_all(int fd, std::size_t size_hint, char const *path);
+};
+
+#endif // SOURCE_FILE_HPP
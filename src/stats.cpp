@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <string_view>
+#include <vector>
+
+#include "stats.hpp"
+
+namespace {
+/// Indexed by NodeKind
+constexpr std::array<std::string_view, num_node_kinds> node_kind_names{
+    "BINARY", "UNARY", "NUMBER", "STRING", "BOOL", "NIL"};
+
+/// Append `counts` as a JSON object, whose members are named by `name`,
+/// skipping the zeros
+template <std::size_t size, typename Name>
+void format_json_counts(
+    fmt::memory_buffer &out,
+    std::array<std::size_t, size> const &counts,
+    Name const &name) {
+  auto const inserter = std::back_inserter(out);
+  out.push_back('{');
+  bool first = true;
+  for (std::size_t idx = 0; idx < size; ++idx) {
+    if (counts[idx] == 0) {
+      continue;
+    }
+    fmt::format_to(
+        inserter, R"({}"{}":{})", first ? "" : ",", name(idx), counts[idx]);
+    first = false;
+  }
+  out.push_back('}');
+}
+
+/// Append `counts` as indented rows of a table, named by `name`, skipping
+/// the zeros
+template <std::size_t size, typename Name>
+void format_table_counts(
+    fmt::memory_buffer &out,
+    std::array<std::size_t, size> const &counts,
+    Name const &name) {
+  for (std::size_t idx = 0; idx < size; ++idx) {
+    if (counts[idx] != 0) {
+      fmt::format_to(
+          std::back_inserter(out), "  {:<18}{:>12}\n", name(idx), counts[idx]);
+    }
+  }
+}
+} // namespace
+
+void RunStats::count_tokens(TokenBuffer const &buffer) {
+  for (std::size_t idx = 0; idx < buffer.size(); ++idx) {
+    ++tokens[static_cast<std::size_t>(buffer.type(idx))];
+  }
+}
+
+void RunStats::count_nodes(Ast const &ast) {
+  // the nodes are in post-order, so the depths of the children of a node are
+  // known when we get to it
+  std::vector<std::size_t> depths(ast.size());
+  for (NodeIndex idx = 0; idx < ast.size(); ++idx) {
+    auto const &node = ast.node(idx);
+    ++nodes[static_cast<std::size_t>(node.kind)];
+    switch (node.kind) {
+    case NodeKind::BINARY: {
+      depths[idx] =
+          std::max(depths[ast.left(idx)], depths[Ast::right(idx)]) + 1;
+      break;
+    }
+    case NodeKind::UNARY: {
+      depths[idx] = depths[Ast::operand(idx)] + 1;
+      break;
+    }
+    default: {
+      depths[idx] = 1;
+    }
+    }
+    max_depth = std::max(max_depth, depths[idx]);
+  }
+}
+
+void RunStats::format(fmt::memory_buffer &out, StatsFormat const format)
+    const {
+  auto const inserter = std::back_inserter(out);
+  auto const total_seconds =
+      std::accumulate(seconds.begin(), seconds.end(), 0.0);
+  auto const total_tokens =
+      std::accumulate(tokens.begin(), tokens.end(), std::size_t{0});
+  auto const total_nodes =
+      std::accumulate(nodes.begin(), nodes.end(), std::size_t{0});
+  auto const token_name = [](std::size_t const idx) {
+    return token_types[idx].name;
+  };
+  auto const node_kind_name = [](std::size_t const idx) {
+    return node_kind_names[idx];
+  };
+
+  if (format == StatsFormat::JSON) {
+    out.append(std::string_view(R"({"seconds":{)"));
+    for (std::size_t idx = 0; idx < num_phases; ++idx) {
+      fmt::format_to(
+          inserter, R"("{}":{:.6f},)", phase_names[idx], seconds[idx]);
+    }
+    fmt::format_to(
+        inserter,
+        R"("total":{:.6f}}},"source_bytes":{},"tokens":{},"tokens_by_type":)",
+        total_seconds,
+        source_bytes,
+        total_tokens);
+    format_json_counts(out, tokens, token_name);
+    fmt::format_to(inserter, R"(,"nodes":{},"nodes_by_kind":)", total_nodes);
+    format_json_counts(out, nodes, node_kind_name);
+    fmt::format_to(inserter, R"(,"max_depth":{}}})", max_depth);
+    out.push_back('\n');
+    return;
+  }
+
+  fmt::format_to(inserter, "{:<20}{:>12}\n", "phase", "ms");
+  for (std::size_t idx = 0; idx < num_phases; ++idx) {
+    fmt::format_to(
+        inserter, "{:<20}{:>12.3f}\n", phase_names[idx], seconds[idx] * 1e3);
+  }
+  fmt::format_to(inserter, "{:<20}{:>12.3f}\n", "total", total_seconds * 1e3);
+  fmt::format_to(inserter, "{:<20}{:>12}\n", "source bytes", source_bytes);
+  fmt::format_to(inserter, "{:<20}{:>12}\n", "tokens", total_tokens);
+  format_table_counts(out, tokens, token_name);
+  fmt::format_to(inserter, "{:<20}{:>12}\n", "nodes", total_nodes);
+  format_table_counts(out, nodes, node_kind_name);
+  fmt::format_to(inserter, "{:<20}{:>12}\n", "max depth", max_depth);
+}
@@ -0,0 +1,129 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fmt/format.h>
+#include <type_traits>
+#include <utility>
+
+#include "ast.hpp"
+#include "token_buffer.hpp"
+#include "token_type.hpp"
+#include "tracer.hpp"
+
+/// The phases of a run that are timed
+enum class Phase : std::uint8_t {
+  LOAD, // reading the script
+  CACHE, // looking it up in the cache, and adding it
+  SCAN,
+  PARSE,
+  RUN, // folding, compiling and evaluating, or printing the AST
+};
+
+inline constexpr std::size_t num_phases =
+    static_cast<std::size_t>(Phase::RUN) + 1;
+
+/// Indexed by Phase
+inline constexpr std::array<char const *, num_phases> phase_names{
+    "load", "cache", "scan", "parse", "run"};
+
+enum class StatsFormat : std::uint8_t {
+  TABLE, // for humans
+  JSON, // one JSON object per run, for tools
+};
+
+/// What a run spent its time on, and what it processed
+struct RunStats {
+  std::array<double, num_phases> seconds{}; // indexed by Phase
+  std::size_t source_bytes{};
+  std::array<std::size_t, num_token_types> tokens{}; // by TokenType
+  std::array<std::size_t, num_node_kinds> nodes{}; // by NodeKind
+  std::size_t max_depth{}; // of the AST, in nodes from the root to a leaf
+
+  /// Count the tokens of `tokens`, including the end of the file
+  void count_tokens(TokenBuffer const &tokens);
+  /// Count the nodes of `ast`, and measure its depth
+  void count_nodes(Ast const &ast);
+
+  void format(fmt::memory_buffer &out, StatsFormat format) const;
+};
+
+template <bool enabled>
+class StatsCollector;
+
+/// Used when the statistics are off: every member function does nothing and
+/// is inlined away, so the code instrumented with it compiles to the same
+/// code as without the instrumentation.
+template <>
+class StatsCollector<false> {
+public:
+  static constexpr bool enabled = false;
+
+  template <typename Func>
+  decltype(auto) time(Phase /*phase*/, Func &&func) {
+    return std::forward<Func>(func)();
+  }
+  void add_source(std::size_t /*bytes*/) {}
+  void count_tokens(TokenBuffer const & /*tokens*/) {}
+  void count_nodes(Ast const & /*ast*/) {}
+};
+
+static_assert(std::is_empty_v<StatsCollector<false>>);
+static_assert(std::is_trivially_destructible_v<StatsCollector<false>>);
+
+/// Times the phases of a run and counts what they processed. The phases are
+/// also traced, when the global tracer is on.
+template <>
+class StatsCollector<true> {
+private:
+  /// Adds the time until it's destroyed to a phase
+  class Timer {
+    double &m_seconds;
+    std::chrono::steady_clock::time_point m_start;
+
+  public:
+    explicit Timer(double &seconds)
+        : m_seconds(seconds),
+          m_start(std::chrono::steady_clock::now()) {}
+    ~Timer() {
+      std::chrono::duration<double> const elapsed =
+          std::chrono::steady_clock::now() - m_start;
+      m_seconds += elapsed.count();
+    }
+    Timer(Timer const &) = delete;
+    Timer &operator=(Timer const &) = delete;
+  };
+
+  RunStats m_stats;
+
+public:
+  static constexpr bool enabled = true;
+
+  /// Call `func` and add the time it took to `phase`
+  template <typename Func>
+  decltype(auto) time(Phase const phase, Func &&func) {
+    auto const idx = static_cast<std::size_t>(phase);
+    Timer const timer(m_stats.seconds[idx]);
+    TraceSpan const span(phase_names[idx]);
+    return std::forward<Func>(func)();
+  }
+  void add_source(std::size_t const bytes) {
+    m_stats.source_bytes += bytes;
+  }
+  void count_tokens(TokenBuffer const &tokens) {
+    m_stats.count_tokens(tokens);
+  }
+  void count_nodes(Ast const &ast) {
+    m_stats.count_nodes(ast);
+  }
+
+  [[nodiscard]] RunStats const &stats() const {
+    return m_stats;
+  }
+};
+
+#endif // STATS_HPP
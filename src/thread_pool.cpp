@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <fmt/format.h>
+#include <utility>
+
+#include "thread_pool.hpp"
+#include "tracer.hpp"
+
+ThreadPool::ThreadPool(std::size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  m_ranges = std::make_unique<TaskRange[]>(num_threads);
+  m_workers.reserve(num_threads - 1);
+  for (std::size_t i = 1; i < num_threads; ++i) {
+    m_workers.emplace_back(&ThreadPool::worker_loop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard const lock(m_mutex);
+    m_stopping = true;
+  }
+  m_work_ready.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(
+    std::size_t const num_tasks,
+    std::function<void(std::size_t)> task) {
+  std::unique_lock lock(m_mutex);
+  m_task = std::move(task);
+  auto const num_threads = size();
+  for (std::size_t idx = 0; idx < num_threads; ++idx) {
+    std::lock_guard const range_lock(m_ranges[idx].mutex);
+    m_ranges[idx].next = num_tasks * idx / num_threads;
+    m_ranges[idx].end = num_tasks * (idx + 1) / num_threads;
+  }
+  m_running = true;
+  ++m_batch;
+  m_work_ready.notify_all();
+
+  lock.unlock();
+  work(0);
+  lock.lock();
+  // every task was started, so the batch is over once the workers that
+  // started them are done
+  m_work_done.wait(lock, [this] { return m_busy_workers == 0; });
+  m_running = false;
+  m_task = nullptr;
+  if (auto const exception = std::exchange(m_exception, nullptr)) {
+    lock.unlock();
+    std::rethrow_exception(exception);
+  }
+}
+
+/// Run tasks of the current batch until there are none left to start
+void ThreadPool::work(std::size_t const self) {
+  while (auto const idx = next_task(self)) {
+    try {
+      m_task(*idx);
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  }
+}
+
+/// Keep the first exception of the batch, and skip the tasks not started yet
+void ThreadPool::fail(std::exception_ptr exception) {
+  {
+    std::lock_guard const lock(m_mutex);
+    if (!m_exception) {
+      m_exception = std::move(exception);
+    }
+  }
+  for (std::size_t idx = 0; idx < size(); ++idx) {
+    std::lock_guard const lock(m_ranges[idx].mutex);
+    m_ranges[idx].next = m_ranges[idx].end;
+  }
+}
+
+/// Take the next task of our range, or steal some from another thread when
+/// ours is empty. Returns nothing once every range is empty.
+std::optional<std::size_t> ThreadPool::next_task(std::size_t const self) {
+  auto &own = m_ranges[self];
+  {
+    std::lock_guard const lock(own.mutex);
+    if (own.next < own.end) {
+      return own.next++;
+    }
+  }
+
+  auto const num_threads = size();
+  for (std::size_t offset = 1; offset < num_threads; ++offset) {
+    auto &victim = m_ranges[(self + offset) % num_threads];
+    std::size_t begin{};
+    std::size_t end{};
+    {
+      std::lock_guard const lock(victim.mutex);
+      if (victim.next == victim.end) {
+        continue;
+      }
+      begin = victim.next + (victim.end - victim.next) / 2;
+      end = victim.end;
+      victim.end = begin;
+    }
+    // nobody steals from an empty range, so ours is still empty
+    std::lock_guard const lock(own.mutex);
+    own.next = begin + 1;
+    own.end = end;
+    return begin;
+  }
+  return std::nullopt;
+}
+
+void ThreadPool::worker_loop(std::size_t const self) {
+  Tracer::global().name_thread(fmt::format("worker {}", self));
+  std::unique_lock lock(m_mutex);
+  std::size_t last_batch = 0;
+  while (true) {
+    m_work_ready.wait(lock, [this, last_batch] {
+      return m_stopping || (m_running && m_batch != last_batch);
+    });
+    if (m_stopping) {
+      return;
+    }
+    last_batch = m_batch;
+    ++m_busy_workers;
+    lock.unlock();
+    work(self);
+    lock.lock();
+    if (--m_busy_workers == 0) {
+      m_work_done.notify_all();
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/// A fixed set of worker threads that run batches of indexed tasks.
+///
+/// `run(num_tasks, task)` calls `task(i)` for every i in [0, num_tasks) and
+/// returns once all of them are done. The indices are split evenly between the
+/// threads, including the calling one, and each thread runs its own share from
+/// the front. A thread that runs out steals the back half of another thread's
+/// share, so long tasks don't hold up the rest, and the threads only contend
+/// when they steal.
+///
+/// When a task throws, the tasks that haven't started yet are skipped, and
+/// `run()` rethrows the first exception once the others are done.
+class ThreadPool {
+private:
+  /// The indices a thread has left to run, [next, end)
+  struct alignas(64) TaskRange {
+    std::mutex mutex;
+    std::size_t next{};
+    std::size_t end{};
+  };
+
+  std::mutex m_mutex;
+  std::condition_variable m_work_ready;
+  std::condition_variable m_work_done;
+  std::function<void(std::size_t)> m_task;
+  std::unique_ptr<TaskRange[]> m_ranges; // one per thread, the caller's first
+  std::exception_ptr m_exception; // the first one a task of the batch threw
+  std::size_t m_busy_workers{}; // the workers still running the batch
+  std::size_t m_batch{}; // incremented for every call to run()
+  bool m_running{false}; // whether a batch can still be joined
+  bool m_stopping{false};
+  std::vector<std::thread> m_workers;
+
+public:
+  /// Create a pool with `num_threads` threads in total, including the thread
+  /// that calls `run()`. Zero means one thread per hardware thread.
+  explicit ThreadPool(std::size_t num_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool &operator=(ThreadPool const &) = delete;
+
+  [[nodiscard]] std::size_t size() const {
+    return m_workers.size() + 1;
+  }
+
+  void run(std::size_t num_tasks, std::function<void(std::size_t)> task);
+
+private:
+  void work(std::size_t self);
+  void fail(std::exception_ptr exception);
+  [[nodiscard]] std::optional<std::size_t> next_task(std::size_t self);
+  void worker_loop(std::size_t self);
+};
+
+#endif // THREAD_POOL_HPP
@@ -2,31 +2,60 @@
 #define TOKEN_HPP
 
 #include <cstddef>
+#include <cstdint>
 #include <fmt/core.h>
-#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
+#include "interner.hpp"
+#include "line_table.hpp"
 #include "token_type.hpp"
 
-/// We use `void *` for m_literal so that we can store different types of Tokens
-/// in a vector
-/// TODO: consider using a class hierarchy for the different Token types
+/// The literal value of a token is stored inline and the token type is its
+/// tag: NUMBER tokens hold their parsed value, while STRING and IDENTIFIER
+/// tokens hold the symbol of their text in the global Interner. The lexeme is
+/// a view into the scanned source, so the source must outlive its tokens.
+///
+/// Tokens don't store their line; it's computed from their offset in the
+/// source with the LineTable of the scanner that produced them.
 class Token {
-  TokenType m_type;
+  TokenType m_type{TokenType::END_OF_FILE};
+  Symbol m_symbol; // only meaningful for STRING and IDENTIFIER tokens
   std::string_view m_lexeme;
-  void *m_literal;
-  std::size_t m_line;
+  double m_number{}; // only meaningful for NUMBER tokens
+  std::uint32_t m_offset{}; // where the lexeme starts in the source
 
 public:
+  Token() = default;
+
+  Token(
+      TokenType const type,
+      std::string_view const lexeme,
+      std::uint32_t const offset)
+      : m_type(type),
+        m_lexeme(lexeme),
+        m_offset(offset) {}
+
+  Token(
+      TokenType const type,
+      std::string_view const lexeme,
+      double const number,
+      std::uint32_t const offset)
+      : m_type(type),
+        m_lexeme(lexeme),
+        m_number(number),
+        m_offset(offset) {}
+
   Token(
       TokenType const type,
       std::string_view const lexeme,
-      void *const literal,
-      unsigned long const line)
+      Symbol const symbol,
+      std::uint32_t const offset)
       : m_type(type),
+        m_symbol(symbol),
         m_lexeme(lexeme),
-        m_literal(literal),
-        m_line(line) {}
+        m_offset(offset) {}
 
   [[nodiscard]] TokenType type() const {
     return m_type;
@@ -36,41 +65,27 @@ public:
     return m_lexeme;
   }
 
-  template <class T>
-  T *literal() const {
-    return static_cast<T *>(m_literal);
+  /// The value of a NUMBER token
+  [[nodiscard]] double number() const {
+    return m_number;
   }
 
-  [[nodiscard]] std::size_t line() const {
-    return m_line;
+  /// The interned text of a STRING (without the quotes) or IDENTIFIER token
+  [[nodiscard]] Symbol symbol() const {
+    return m_symbol;
   }
 
-  // we don't use a destructor so that if Token is stored in a std::vector and
-  // the vector is resized, the move operator can treat the Token a trivially
-  // copyable. This means that the owner of each token must call free_token of
-  // it. (pesimization?)
-  void free_token() const {
-    switch (m_type) {
-    case TokenType::STRING: {
-      delete static_cast<std::string *>(m_literal);
-      break;
-    }
-    case TokenType::NUMBER: {
-      delete static_cast<double *>(m_literal);
-      break;
-    }
-    case TokenType::IDENTIFIER: {
-      delete static_cast<std::string *>(m_literal);
-      break;
-    }
-    default: {
-      break;
-    }
-    }
+  [[nodiscard]] std::string_view text() const {
+    return Interner::global().view(m_symbol);
+  }
+
+  [[nodiscard]] std::uint32_t offset() const {
+    return m_offset;
   }
 
-  [[nodiscard]] std::string to_string() const {
-    return std::to_string(m_line)
+  /// `lines` must be the line table of the source the token was scanned from
+  [[nodiscard]] std::string to_string(LineTable const &lines) const {
+    return std::to_string(lines.line(m_offset))
         .append(": ")
         .append(tt_to_string(m_type))
         .append(" ")
@@ -81,126 +96,22 @@ public:
 
   [[nodiscard]] std::string literal_to_string() const {
     switch (m_type) {
-    case TokenType::LEFT_PAREN: {
-      return "(";
-    }
-    case TokenType::RIGHT_PAREN: {
-      return ")";
-    }
-    case TokenType::LEFT_BRACE: {
-      return "{";
-    }
-    case TokenType::RIGHT_BRACE: {
-      return "}";
-    }
-    case TokenType::COMMA: {
-      return ",";
-    }
-    case TokenType::DOT: {
-      return ".";
-    }
-    case TokenType::MINUS: {
-      return "-";
-    }
-    case TokenType::PLUS: {
-      return "+";
-    }
-    case TokenType::SEMICOLON: {
-      return ";";
-    }
-    case TokenType::SLASH: {
-      return "/";
-    }
-    case TokenType::STAR: {
-      return "*";
-    }
-    case TokenType::BANG: {
-      return "!";
-    }
-    case TokenType::BANG_EQUAL: {
-      return "!=";
-    }
-    case TokenType::EQUAL: {
-      return "=";
-    }
-    case TokenType::EQUAL_EQUAL: {
-      return "==";
-    }
-    case TokenType::GREATER: {
-      return ">";
-    }
-    case TokenType::GREATER_EQUAL: {
-      return ">=";
-    }
-    case TokenType::LESS: {
-      return "<";
-    }
-    case TokenType::LESS_EQUAL: {
-      return "<=";
-    }
-    case TokenType::END_OF_FILE: {
-      return "EOF";
-    }
-    case TokenType::IDENTIFIER: {
-      return *static_cast<std::string *>(m_literal);
-    }
-    case TokenType::NUMBER: {
-      return fmt::format("{}", *static_cast<double *>(m_literal));
-    }
+    case TokenType::IDENTIFIER:
     case TokenType::STRING: {
-      return *static_cast<std::string *>(m_literal);
-    }
-    case TokenType::AND: {
-      return "and";
+      return std::string(text());
     }
-    case TokenType::CLASS: {
-      return "class";
-    }
-    case TokenType::ELSE: {
-      return "else";
-    }
-    case TokenType::FALSE: {
-      return "false";
-    }
-    case TokenType::FUN: {
-      return "fun";
-    }
-    case TokenType::FOR: {
-      return "for";
-    }
-    case TokenType::IF: {
-      return "if";
-    }
-    case TokenType::NIL: {
-      return "nil";
-    }
-    case TokenType::OR: {
-      return "or";
-    }
-    case TokenType::PRINT: {
-      return "print";
-    }
-    case TokenType::RETURN: {
-      return "return";
-    }
-    case TokenType::SUPER: {
-      return "super";
-    }
-    case TokenType::THIS: {
-      return "this";
-    }
-    case TokenType::TRUE: {
-      return "true";
-    }
-    case TokenType::VAR: {
-      return "var";
+    case TokenType::NUMBER: {
+      return fmt::format("{}", m_number);
     }
-    case TokenType::WHILE: {
-      return "while";
+    default: {
+      return std::string(token_type_info(m_type).spelling);
     }
     }
-    throw std::runtime_error("Unexpected token type");
   }
 };
 
+// tokens are stored by value in std::vector, so when the vector grows they must
+// be relocatable with a plain memcpy
+static_assert(std::is_trivially_copyable_v<Token>);
+
 #endif // TOKEN_HPP
@@ -0,0 +1,265 @@
+#ifndef TOKEN_BUFFER_HPP
+#define TOKEN_BUFFER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "line_table.hpp"
+#include "token.hpp"
+
+/// A compact, struct-of-arrays store for a whole token stream.
+///
+/// Every token costs a byte for its type, and four bytes each for its offset,
+/// its length and its payload: the symbol of STRING and IDENTIFIER tokens, or
+/// the index of the value of NUMBER tokens in a side array. The lexemes are
+/// recovered from the source, and the lines and columns from the line table.
+/// `operator[]` puts the pieces back together in a Token.
+class TokenBuffer {
+private:
+  std::string_view m_source;
+  LineTable m_lines;
+  std::vector<TokenType> m_types;
+  std::vector<std::uint32_t> m_offsets;
+  std::vector<std::uint32_t> m_lengths;
+  std::vector<std::uint32_t> m_payloads;
+  std::vector<double> m_numbers;
+  std::size_t m_dead_numbers{}; // values no token refers to since a replace()
+
+public:
+  class Iterator {
+    TokenBuffer const *m_buffer{};
+    std::size_t m_idx{};
+
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Token;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Token;
+
+    Iterator() = default;
+    Iterator(TokenBuffer const &buffer, std::size_t const idx)
+        : m_buffer(&buffer),
+          m_idx(idx) {}
+
+    Token operator*() const {
+      return (*m_buffer)[m_idx];
+    }
+    Iterator &operator++() {
+      ++m_idx;
+      return *this;
+    }
+    Iterator operator++(int) {
+      auto const old = *this;
+      ++m_idx;
+      return old;
+    }
+    friend bool operator==(Iterator const &lhs, Iterator const &rhs) {
+      return lhs.m_idx == rhs.m_idx;
+    }
+  };
+
+  explicit TokenBuffer(std::string_view const source) : m_source(source) {}
+
+  void push_back(Token const &token) {
+    m_types.push_back(token.type());
+    m_offsets.push_back(token.offset());
+    m_lengths.push_back(static_cast<std::uint32_t>(token.lexeme().size()));
+    if (token.type() == TokenType::NUMBER) {
+      m_payloads.push_back(static_cast<std::uint32_t>(m_numbers.size()));
+      m_numbers.push_back(token.number());
+    } else {
+      m_payloads.push_back(token.symbol().id());
+    }
+  }
+
+  void reserve(std::size_t const num_tokens, std::size_t const num_numbers) {
+    m_types.reserve(num_tokens);
+    m_offsets.reserve(num_tokens);
+    m_lengths.reserve(num_tokens);
+    m_payloads.reserve(num_tokens);
+    m_numbers.reserve(num_numbers);
+  }
+
+  [[nodiscard]] std::size_t number_count() const {
+    return m_numbers.size();
+  }
+
+  /// Append the tokens of another buffer over the same source
+  void append(TokenBuffer const &other) {
+    m_types.insert(m_types.end(), other.m_types.begin(), other.m_types.end());
+    m_offsets.insert(
+        m_offsets.end(),
+        other.m_offsets.begin(),
+        other.m_offsets.end());
+    m_lengths.insert(
+        m_lengths.end(),
+        other.m_lengths.begin(),
+        other.m_lengths.end());
+    // the values of numbers move to the end of our side array
+    auto const number_base = static_cast<std::uint32_t>(m_numbers.size());
+    auto const first = m_payloads.size();
+    m_payloads.insert(
+        m_payloads.end(),
+        other.m_payloads.begin(),
+        other.m_payloads.end());
+    if (number_base != 0) {
+      for (std::size_t idx = 0; idx < other.size(); ++idx) {
+        if (other.m_types[idx] == TokenType::NUMBER) {
+          m_payloads[first + idx] += number_base;
+        }
+      }
+    }
+    m_numbers.insert(
+        m_numbers.end(),
+        other.m_numbers.begin(),
+        other.m_numbers.end());
+    m_dead_numbers += other.m_dead_numbers;
+  }
+
+  /// Replace the tokens [first, last) with those of `tokens`, which were
+  /// scanned from the new source, and move the tokens after them by `shift`
+  /// bytes, after an edit of the source
+  void replace(
+      std::size_t const first,
+      std::size_t const last,
+      TokenBuffer const &tokens,
+      std::int64_t const shift) {
+    m_source = tokens.m_source;
+    auto const at = [first](auto &vector) {
+      return vector.begin() + static_cast<std::ptrdiff_t>(first);
+    };
+    auto const count = static_cast<std::ptrdiff_t>(last - first);
+    m_dead_numbers += static_cast<std::size_t>(
+        std::count(at(m_types), at(m_types) + count, TokenType::NUMBER));
+    m_types.erase(at(m_types), at(m_types) + count);
+    m_types.insert(at(m_types), tokens.m_types.begin(), tokens.m_types.end());
+    m_offsets.erase(at(m_offsets), at(m_offsets) + count);
+    m_offsets.insert(
+        at(m_offsets), tokens.m_offsets.begin(), tokens.m_offsets.end());
+    m_lengths.erase(at(m_lengths), at(m_lengths) + count);
+    m_lengths.insert(
+        at(m_lengths), tokens.m_lengths.begin(), tokens.m_lengths.end());
+    m_payloads.erase(at(m_payloads), at(m_payloads) + count);
+    m_payloads.insert(
+        at(m_payloads), tokens.m_payloads.begin(), tokens.m_payloads.end());
+
+    // the values of the new numbers go to the end of the side array, and the
+    // old ones are left unused until they make up half of it
+    auto const number_base = static_cast<std::uint32_t>(m_numbers.size());
+    for (std::size_t idx = first; idx < first + tokens.size(); ++idx) {
+      if (m_types[idx] == TokenType::NUMBER) {
+        m_payloads[idx] += number_base;
+      }
+    }
+    m_numbers.insert(
+        m_numbers.end(), tokens.m_numbers.begin(), tokens.m_numbers.end());
+    if (m_dead_numbers > m_numbers.size() / 2) {
+      compact_numbers();
+    }
+
+    for (auto idx = first + tokens.size(); idx < m_offsets.size(); ++idx) {
+      m_offsets[idx] = static_cast<std::uint32_t>(m_offsets[idx] + shift);
+    }
+  }
+
+  void set_lines(LineTable lines) {
+    m_lines = std::move(lines);
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    return m_types.size();
+  }
+
+  [[nodiscard]] TokenType type(std::size_t const idx) const {
+    return m_types[idx];
+  }
+
+  [[nodiscard]] std::uint32_t offset(std::size_t const idx) const {
+    return m_offsets[idx];
+  }
+
+  [[nodiscard]] std::uint32_t length(std::size_t const idx) const {
+    return m_lengths[idx];
+  }
+
+  [[nodiscard]] std::string_view lexeme(std::size_t const idx) const {
+    return m_source.substr(m_offsets[idx], m_lengths[idx]);
+  }
+
+  [[nodiscard]] std::size_t line(std::size_t const idx) const {
+    return m_lines.line(m_offsets[idx]);
+  }
+
+  [[nodiscard]] std::size_t column(std::size_t const idx) const {
+    return m_lines.column(m_offsets[idx]);
+  }
+
+  [[nodiscard]] LineTable const &lines() const {
+    return m_lines;
+  }
+  /// The lines, to update along with the tokens after an edit of the source
+  [[nodiscard]] LineTable &lines() {
+    return m_lines;
+  }
+
+  [[nodiscard]] Token operator[](std::size_t const idx) const {
+    switch (m_types[idx]) {
+    case TokenType::NUMBER: {
+      return {
+          m_types[idx],
+          lexeme(idx),
+          m_numbers[m_payloads[idx]],
+          m_offsets[idx]};
+    }
+    case TokenType::STRING:
+    case TokenType::IDENTIFIER: {
+      return {m_types[idx], lexeme(idx), Symbol(m_payloads[idx]), m_offsets[idx]};
+    }
+    default: {
+      return {m_types[idx], lexeme(idx), m_offsets[idx]};
+    }
+    }
+  }
+
+  [[nodiscard]] Iterator begin() const {
+    return {*this, 0};
+  }
+
+  [[nodiscard]] Iterator end() const {
+    return {*this, size()};
+  }
+
+  /// The bytes allocated for the tokens, excluding the line table
+  [[nodiscard]] std::size_t memory_usage() const {
+    return m_types.capacity() * sizeof(TokenType)
+        + m_offsets.capacity() * sizeof(std::uint32_t)
+        + m_lengths.capacity() * sizeof(std::uint32_t)
+        + m_payloads.capacity() * sizeof(std::uint32_t)
+        + m_numbers.capacity() * sizeof(double);
+  }
+
+private:
+  /// Drop the values that no token refers to, keeping the others in the order
+  /// of their tokens
+  void compact_numbers() {
+    std::vector<double> numbers;
+    numbers.reserve(m_numbers.size() - m_dead_numbers);
+    for (std::size_t idx = 0; idx < size(); ++idx) {
+      if (m_types[idx] == TokenType::NUMBER) {
+        auto &payload = m_payloads[idx];
+        numbers.push_back(m_numbers[payload]);
+        payload = static_cast<std::uint32_t>(numbers.size() - 1);
+      }
+    }
+    m_numbers = std::move(numbers);
+    m_dead_numbers = 0;
+  }
+};
+
+#endif // TOKEN_BUFFER_HPP
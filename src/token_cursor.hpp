@@ -0,0 +1,86 @@
+#ifndef TOKEN_CURSOR_HPP
+#define TOKEN_CURSOR_HPP
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+
+#include "scanner.hpp"
+#include "token.hpp"
+#include "token_buffer.hpp"
+
+/// A cursor over the tokens of a Scanner. The tokens are pulled from the
+/// scanner only when they're looked at, and are kept in a small ring buffer
+/// that holds the previous token, the current one, and a couple of tokens of
+/// lookahead. This way the memory used for tokens doesn't depend on the size of
+/// the source.
+///
+/// A cursor can also go over a range of tokens that were already scanned into
+/// a TokenBuffer, e.g. to parse again a part of an edited source.
+class TokenCursor {
+private:
+  static constexpr std::size_t capacity = 4; // must be a power of two
+  static constexpr std::size_t mask = capacity - 1;
+
+  Scanner *m_scanner{};
+  // the range of buffered tokens, when not pulling from a scanner
+  TokenBuffer const *m_buffer{};
+  mutable std::size_t m_next{};
+  std::size_t m_end{};
+  // the buffer is filled lazily, even when peeking from const member functions
+  mutable std::array<Token, capacity> m_ring{};
+  mutable std::size_t m_scanned{}; // number of tokens pulled from the scanner
+  std::size_t m_current{}; // number of tokens consumed
+
+public:
+  /// The maximum number of tokens that can be peeked after the current one
+  static constexpr std::size_t max_lookahead = capacity - 2;
+
+  explicit TokenCursor(Scanner &scanner) : m_scanner(&scanner) {}
+
+  /// A cursor over the tokens [begin, end) of `buffer`, followed by an
+  /// END_OF_FILE token at the offset of the token at `end`
+  TokenCursor(
+      TokenBuffer const &buffer,
+      std::size_t const begin,
+      std::size_t const end)
+      : m_buffer(&buffer),
+        m_next(begin),
+        m_end(end) {}
+
+  /// Return the current token, or if `ahead` is non-zero, the token that many
+  /// places after it
+  [[nodiscard]] Token const &peek(std::size_t const ahead = 0) const {
+    assert(ahead <= max_lookahead);
+    while (m_scanned <= m_current + ahead) {
+      m_ring[m_scanned & mask] = next_token();
+      ++m_scanned;
+    }
+    return m_ring[(m_current + ahead) & mask];
+  }
+
+  /// Return the last consumed token
+  [[nodiscard]] Token const &previous() const {
+    assert(m_current > 0);
+    return m_ring[(m_current - 1) & mask];
+  }
+
+  /// Consume the current token
+  void advance() {
+    static_cast<void>(peek());
+    ++m_current;
+  }
+
+private:
+  [[nodiscard]] Token next_token() const {
+    if (m_scanner != nullptr) {
+      return m_scanner->next_token();
+    }
+    if (m_next < m_end) {
+      return (*m_buffer)[m_next++];
+    }
+    return {TokenType::END_OF_FILE, "", m_buffer->offset(m_end)};
+  }
+};
+
+#endif // TOKEN_CURSOR_HPP
@@ -1,9 +1,14 @@
 #ifndef TOKEN_TYPE_HPP
 #define TOKEN_TYPE_HPP
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 
-enum class TokenType {
+enum class TokenType : std::uint8_t {
   // single-character tokens
   LEFT_PAREN,
   RIGHT_PAREN,
@@ -52,6 +57,168 @@ enum class TokenType {
   END_OF_FILE
 };
 
+inline constexpr std::size_t num_token_types =
+    static_cast<std::size_t>(TokenType::END_OF_FILE) + 1;
+
+struct TokenTypeInfo {
+  TokenType type;
+  std::string_view name;
+  std::string_view spelling;
+};
+
+/// The single source of truth for the names and the spellings of the token
+/// types, indexed by TokenType. The rows between AND and WHILE are the reserved
+/// words of the language, which the scanner recognizes with `keyword_type()`.
+inline constexpr std::array<TokenTypeInfo, num_token_types> token_types{{
+    // single-character tokens
+    {TokenType::LEFT_PAREN, "LEFT_PAREN", "("},
+    {TokenType::RIGHT_PAREN, "RIGHT_PAREN", ")"},
+    {TokenType::LEFT_BRACE, "LEFT_BRACE", "{"},
+    {TokenType::RIGHT_BRACE, "RIGHT_BRACE", "}"},
+    {TokenType::COMMA, "COMMA", ","},
+    {TokenType::DOT, "DOT", "."},
+    {TokenType::MINUS, "MINUS", "-"},
+    {TokenType::PLUS, "PLUS", "+"},
+    {TokenType::SEMICOLON, "SEMICOLON", ";"},
+    {TokenType::SLASH, "SLASH", "/"},
+    {TokenType::STAR, "STAR", "*"},
+
+    // one- or two-character tokens
+    {TokenType::BANG, "BANG", "!"},
+    {TokenType::BANG_EQUAL, "BANG_EQUAL", "!="},
+    {TokenType::EQUAL, "EQUAL", "="},
+    {TokenType::EQUAL_EQUAL, "EQUAL_EQUAL", "=="},
+    {TokenType::GREATER, "GREATER", ">"},
+    {TokenType::GREATER_EQUAL, "GREATER_EQUAL", ">="},
+    {TokenType::LESS, "LESS", "<"},
+    {TokenType::LESS_EQUAL, "LESS_EQUAL", "<="},
+
+    // literals (their spelling depends on the token)
+    {TokenType::IDENTIFIER, "IDENTIFIER", ""},
+    {TokenType::STRING, "STRING", ""},
+    {TokenType::NUMBER, "NUMBER", ""},
+
+    // keywords
+    {TokenType::AND, "AND", "and"},
+    {TokenType::CLASS, "CLASS", "class"},
+    {TokenType::ELSE, "ELSE", "else"},
+    {TokenType::FALSE, "FALSE", "false"},
+    {TokenType::FUN, "FUN", "fun"},
+    {TokenType::FOR, "FOR", "for"},
+    {TokenType::IF, "IF", "if"},
+    {TokenType::NIL, "NIL", "nil"},
+    {TokenType::OR, "OR", "or"},
+    {TokenType::PRINT, "PRINT", "print"},
+    {TokenType::RETURN, "RETURN", "return"},
+    {TokenType::SUPER, "SUPER", "super"},
+    {TokenType::THIS, "THIS", "this"},
+    {TokenType::TRUE, "TRUE", "true"},
+    {TokenType::VAR, "VAR", "var"},
+    {TokenType::WHILE, "WHILE", "while"},
+
+    {TokenType::END_OF_FILE, "END_OF_FILE", "EOF"},
+}};
+
+constexpr TokenTypeInfo const &token_type_info(TokenType const type) {
+  return token_types[static_cast<std::size_t>(type)];
+}
+
+static_assert(
+    [] {
+      for (std::size_t i = 0; i < num_token_types; ++i) {
+        if (static_cast<std::size_t>(token_types[i].type) != i) {
+          return false;
+        }
+      }
+      return true;
+    }(),
+    "token_types must be in the same order as TokenType");
+
+namespace detail {
+inline constexpr std::size_t keyword_first =
+    static_cast<std::size_t>(TokenType::AND);
+inline constexpr std::size_t keyword_last =
+    static_cast<std::size_t>(TokenType::WHILE);
+inline constexpr std::size_t keyword_table_size = 32;
+inline constexpr auto keyword_lengths = [] {
+  std::array<std::size_t, 2> min_max{~std::size_t{}, 0};
+  for (std::size_t i = keyword_first; i <= keyword_last; ++i) {
+    min_max[0] = std::min(min_max[0], token_types[i].spelling.size());
+    min_max[1] = std::max(min_max[1], token_types[i].spelling.size());
+  }
+  return min_max;
+}();
+
+struct KeywordHash {
+  std::size_t first_mult;
+  std::size_t last_mult;
+
+  [[nodiscard]] constexpr std::size_t operator()(std::string_view word) const {
+    auto const first = static_cast<unsigned char>(word.front());
+    auto const last = static_cast<unsigned char>(word.back());
+    return (first * first_mult + last * last_mult + word.size())
+        % keyword_table_size;
+  }
+};
+
+/// Search at compile time for the multipliers that make KeywordHash a perfect
+/// hash of the reserved words. Returns {0, 0} if there are none.
+constexpr KeywordHash find_keyword_hash() {
+  for (std::size_t first_mult = 1; first_mult < 64; ++first_mult) {
+    for (std::size_t last_mult = 0; last_mult < 64; ++last_mult) {
+      KeywordHash const hash{first_mult, last_mult};
+      std::array<bool, keyword_table_size> used{};
+      bool collision = false;
+      for (std::size_t i = keyword_first; i <= keyword_last && !collision;
+           ++i) {
+        auto const slot = hash(token_types[i].spelling);
+        collision = used[slot];
+        used[slot] = true;
+      }
+      if (!collision) {
+        return hash;
+      }
+    }
+  }
+  return {0, 0};
+}
+
+inline constexpr KeywordHash keyword_hash = find_keyword_hash();
+static_assert(
+    keyword_hash.first_mult != 0,
+    "no perfect hash found for the reserved words, grow keyword_table_size");
+
+/// The reserved words placed in the slot given by keyword_hash. Empty slots
+/// map to IDENTIFIER.
+inline constexpr auto keyword_table = [] {
+  std::array<TokenType, keyword_table_size> table{};
+  table.fill(TokenType::IDENTIFIER);
+  for (std::size_t i = keyword_first; i <= keyword_last; ++i) {
+    table[keyword_hash(token_types[i].spelling)] = token_types[i].type;
+  }
+  return table;
+}();
+} // namespace detail
+
+/// Return the type of the reserved word `word`, or IDENTIFIER if `word` is not
+/// a reserved word. This costs one hash of the first and last characters and
+/// one string comparison.
+constexpr TokenType keyword_type(std::string_view const word) {
+  if (word.size() < detail::keyword_lengths[0]
+      || word.size() > detail::keyword_lengths[1]) {
+    return TokenType::IDENTIFIER;
+  }
+  auto const type = detail::keyword_table[detail::keyword_hash(word)];
+  if (token_type_info(type).spelling != word) {
+    return TokenType::IDENTIFIER;
+  }
+  return type;
+}
+
+static_assert(keyword_type("while") == TokenType::WHILE);
+static_assert(keyword_type("whilst") == TokenType::IDENTIFIER);
+static_assert(keyword_type("i") == TokenType::IDENTIFIER);
+
 std::string tt_to_string(TokenType const type);
 
 #endif // TOKEN_TYPE_HPP
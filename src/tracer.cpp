@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fmt/format.h>
+#include <iterator>
+#include <memory>
+#include <system_error>
+#include <unistd.h> // getpid
+#include <utility>
+
+#include "diagnostics.hpp"
+#include "tracer.hpp"
+
+Tracer &Tracer::global() {
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::start() {
+  m_start = std::chrono::steady_clock::now();
+  m_enabled.store(true, std::memory_order_relaxed);
+  name_thread("main");
+}
+
+void Tracer::stop() {
+  m_enabled.store(false, std::memory_order_relaxed);
+  std::lock_guard const lock(m_mutex);
+  // the threads keep their buffers, which they point to
+  for (auto &thread : m_threads) {
+    thread->events.clear();
+    thread->next = 0;
+    thread->dropped = 0;
+    thread->details_end = 0;
+  }
+}
+
+void Tracer::name_thread(std::string name) {
+  if (enabled()) {
+    thread_events().name = std::move(name);
+  }
+}
+
+void Tracer::record(
+    char const *name,
+    std::string_view const detail,
+    std::chrono::steady_clock::time_point const start,
+    std::chrono::steady_clock::time_point const end) {
+  auto &thread = thread_events();
+  Event *event = nullptr;
+  if (thread.events.size() < events_per_thread) {
+    event = &thread.events.emplace_back();
+  } else {
+    event = &thread.events[thread.next];
+    thread.next = (thread.next + 1) % events_per_thread;
+    ++thread.dropped;
+  }
+  event->name = name;
+  // a detail longer than the whole buffer keeps its start
+  auto const size = std::min(detail.size(), detail_bytes_per_thread);
+  event->detail_start = thread.details_end;
+  event->detail_size = static_cast<std::uint32_t>(size);
+  if (size > 0) {
+    auto const at = thread.details_end % detail_bytes_per_thread;
+    auto const before_wrap = std::min(size, detail_bytes_per_thread - at);
+    std::memcpy(thread.details.get() + at, detail.data(), before_wrap);
+    std::memcpy(
+        thread.details.get(), detail.data() + before_wrap, size - before_wrap);
+    thread.details_end += size;
+  }
+  event->start =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_start)
+          .count();
+  event->duration =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count();
+}
+
+/// The events of the calling thread, which are added on its first event
+Tracer::ThreadEvents &Tracer::thread_events() {
+  thread_local ThreadEvents *events = nullptr;
+  if (events == nullptr) {
+    std::lock_guard const lock(m_mutex);
+    auto const id = static_cast<std::uint32_t>(m_threads.size() + 1);
+    events = m_threads.emplace_back(std::make_unique<ThreadEvents>()).get();
+    events->id = id;
+    events->name = fmt::format("thread {}", id);
+    // in full, so that recording never allocates. The pages are only touched
+    // as they're used.
+    events->events.reserve(events_per_thread);
+    events->details =
+        std::make_unique_for_overwrite<char[]>(detail_bytes_per_thread);
+  }
+  return *events;
+}
+
+std::string Tracer::detail(ThreadEvents const &thread, Event const &event) {
+  if (thread.details_end - event.detail_start > detail_bytes_per_thread) {
+    return {};
+  }
+  std::string detail(event.detail_size, '\0');
+  auto const at = event.detail_start % detail_bytes_per_thread;
+  auto const before_wrap =
+      std::min(detail.size(), detail_bytes_per_thread - at);
+  std::memcpy(detail.data(), thread.details.get() + at, before_wrap);
+  std::memcpy(
+      detail.data() + before_wrap,
+      thread.details.get(),
+      detail.size() - before_wrap);
+  return detail;
+}
+
+void Tracer::write(char const *path) {
+  fmt::memory_buffer out;
+  auto const inserter = std::back_inserter(out);
+  auto const pid = getpid();
+  std::size_t dropped = 0;
+  out.append(std::string_view(R"({"traceEvents":[)"));
+  {
+    std::lock_guard const lock(m_mutex);
+    auto separator = "\n";
+    for (auto const &thread : m_threads) {
+      fmt::format_to(
+          inserter,
+          R"({}{{"name":"thread_name","ph":"M","pid":{},"tid":{},)"
+          R"("args":{{"name":)",
+          separator,
+          pid,
+          thread->id);
+      format_json_string(out, thread->name);
+      out.append(std::string_view("}}"));
+      separator = ",\n";
+      for (auto const &event : thread->events) {
+        // in microseconds, as the format wants
+        fmt::format_to(
+            inserter,
+            R"({}{{"name":"{}","ph":"X","pid":{},"tid":{},"ts":{:.3f},)"
+            R"("dur":{:.3f})",
+            separator,
+            event.name,
+            pid,
+            thread->id,
+            static_cast<double>(event.start) / 1e3,
+            static_cast<double>(event.duration) / 1e3);
+        if (auto const text = detail(*thread, event); !text.empty()) {
+          out.append(std::string_view(R"(,"args":{"detail":)"));
+          format_json_string(out, text);
+          out.push_back('}');
+        }
+        out.push_back('}');
+      }
+      dropped += thread->dropped;
+    }
+  }
+  fmt::format_to(
+      inserter,
+      R"(
+],"displayTimeUnit":"ms","otherData":{{"dropped_events":{}}}}})"
+      "\n",
+      dropped);
+
+  auto *const file = std::fopen(path, "w");
+  if (file == nullptr) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  auto written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  written = std::fclose(file) == 0 && written;
+  if (!written) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+}
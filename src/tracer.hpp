@@ -0,0 +1,130 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Records spans of time on every thread, and writes them out as a Chrome
+/// trace (the trace-event JSON format that chrome://tracing and Perfetto
+/// load), to see the timeline of a run.
+///
+/// Every thread records its spans in ring buffers of its own, allocated in
+/// full before its first span, without locks, and nothing is formatted or
+/// written until `write()`, so that tracing disturbs the timings it records as
+/// little as possible. When a thread records more spans than its buffers hold,
+/// the oldest ones are dropped, and so are the details of old spans once the
+/// details of the newer ones take up their room.
+///
+/// Nothing is recorded until `start()`, and the spans then cost a relaxed
+/// atomic load each.
+class Tracer {
+public:
+  static constexpr std::size_t events_per_thread = 64 * 1024;
+  /// 64 bytes of details for every event, on average
+  static constexpr std::size_t detail_bytes_per_thread = 64 * events_per_thread;
+
+private:
+  struct Event {
+    char const *name; // a string literal
+    std::uint64_t detail_start; // in the details of the thread
+    std::uint32_t detail_size;
+    std::int64_t start; // in ns since start()
+    std::int64_t duration; // in ns
+  };
+
+  /// The spans of one thread. Only that thread touches them until `write()`.
+  struct ThreadEvents {
+    std::uint32_t id{};
+    std::string name;
+    std::vector<Event> events; // a ring buffer once full
+    std::size_t next{}; // where the next event goes once full
+    std::size_t dropped{};
+    // the details of the events, e.g. the file a span is about, one after the
+    // other in a ring buffer of detail_bytes_per_thread bytes. The positions
+    // count every byte written, to tell which details were written over.
+    std::unique_ptr<char[]> details;
+    std::uint64_t details_end{};
+  };
+
+  std::atomic<bool> m_enabled{false};
+  std::chrono::steady_clock::time_point m_start;
+  std::mutex m_mutex; // for adding threads
+  std::vector<std::unique_ptr<ThreadEvents>> m_threads;
+
+  Tracer() = default;
+
+public:
+  Tracer(Tracer const &) = delete;
+  Tracer &operator=(Tracer const &) = delete;
+
+  /// The tracer of the process
+  static Tracer &global();
+
+  /// Start recording, naming the calling thread "main"
+  void start();
+  [[nodiscard]] bool enabled() const {
+    return m_enabled.load(std::memory_order_relaxed);
+  }
+
+  /// Stop recording and forget what was recorded, once the other threads are
+  /// done recording
+  void stop();
+
+  /// Name the calling thread in the trace
+  void name_thread(std::string name);
+
+  /// Record that `name` ran from `start` to `end` on the calling thread
+  void record(
+      char const *name,
+      std::string_view detail,
+      std::chrono::steady_clock::time_point start,
+      std::chrono::steady_clock::time_point end);
+
+  /// Write everything recorded to `path`, once the other threads are done
+  /// recording.
+  /// Throws std::system_error if the file can't be written.
+  void write(char const *path);
+
+private:
+  ThreadEvents &thread_events();
+  /// The detail of `event`, or nothing if it was written over
+  static std::string detail(ThreadEvents const &thread, Event const &event);
+};
+
+/// Records the time from its construction to its destruction as a span of
+/// the global tracer, if it's enabled
+class TraceSpan {
+private:
+  char const *m_name;
+  std::string_view m_detail;
+  std::chrono::steady_clock::time_point m_start;
+  bool m_enabled;
+
+public:
+  /// `name` must be a string literal, and `detail` must outlive the span
+  explicit TraceSpan(char const *name, std::string_view detail = {})
+      : m_name(name),
+        m_detail(detail),
+        m_enabled(Tracer::global().enabled()) {
+    if (m_enabled) {
+      m_start = std::chrono::steady_clock::now();
+    }
+  }
+  ~TraceSpan() {
+    if (m_enabled) {
+      Tracer::global().record(
+          m_name, m_detail, m_start, std::chrono::steady_clock::now());
+    }
+  }
+  TraceSpan(TraceSpan const &) = delete;
+  TraceSpan &operator=(TraceSpan const &) = delete;
+};
+
+#endif // TRACER_HPP
@@ -0,0 +1,21 @@
+#include <cmath>
+#include <fmt/format.h>
+
+#include "value.hpp"
+
+std::string Value::to_string() const {
+  if (is_number()) {
+    // IEEE-754 leaves the sign of NaN results unspecified, so don't show it
+    if (std::isnan(as_number())) {
+      return "nan";
+    }
+    return fmt::format("{}", as_number());
+  }
+  if (is_string()) {
+    return std::string(Interner::global().view(as_string()));
+  }
+  if (is_bool()) {
+    return as_bool() ? "true" : "false";
+  }
+  return "nil";
+}
@@ -0,0 +1,92 @@
+#ifndef VALUE_HPP
+#define VALUE_HPP
+
+#include <bit>
+#include <cstdint>
+#include <string>
+
+#include "interner.hpp"
+
+/// A Lox runtime value, NaN-boxed in a single 64-bit word.
+///
+/// A double is stored as is. The other types are encoded in quiet NaNs that
+/// arithmetic never produces: all of them have the `quiet_nan` bits set, which
+/// include the top bit of the mantissa *and* the one below it, while the NaNs
+/// made by the hardware only set the top bit. Strings also set the sign bit and
+/// keep the id of their interned Symbol in the low 32 bits; nil, false and true
+/// are the tags 1, 2 and 3.
+///
+/// Values are trivially copyable and never allocate, so arithmetic on them is
+/// just arithmetic on doubles.
+class Value {
+private:
+  static constexpr std::uint64_t sign_bit = 0x8000'0000'0000'0000;
+  static constexpr std::uint64_t quiet_nan = 0x7ffc'0000'0000'0000;
+  static constexpr std::uint64_t nil_tag = 1;
+  static constexpr std::uint64_t false_tag = 2;
+  static constexpr std::uint64_t true_tag = 3;
+  static constexpr std::uint64_t string_bits = sign_bit | quiet_nan;
+
+  std::uint64_t m_bits;
+
+  explicit constexpr Value(std::uint64_t const bits) : m_bits(bits) {}
+
+public:
+  /// nil
+  constexpr Value() : m_bits(quiet_nan | nil_tag) {}
+  explicit constexpr Value(double const number)
+      : m_bits(std::bit_cast<std::uint64_t>(number)) {}
+  explicit constexpr Value(bool const boolean)
+      : m_bits(quiet_nan | (boolean ? true_tag : false_tag)) {}
+  explicit Value(Symbol const string)
+      : m_bits(string_bits | string.id()) {}
+
+  [[nodiscard]] constexpr bool is_number() const {
+    return (m_bits & quiet_nan) != quiet_nan;
+  }
+  [[nodiscard]] constexpr bool is_nil() const {
+    return m_bits == (quiet_nan | nil_tag);
+  }
+  [[nodiscard]] constexpr bool is_bool() const {
+    return (m_bits | 1U) == (quiet_nan | true_tag);
+  }
+  [[nodiscard]] constexpr bool is_string() const {
+    return (m_bits & string_bits) == string_bits;
+  }
+
+  [[nodiscard]] constexpr double as_number() const {
+    return std::bit_cast<double>(m_bits);
+  }
+  [[nodiscard]] constexpr bool as_bool() const {
+    return m_bits == (quiet_nan | true_tag);
+  }
+  [[nodiscard]] Symbol as_string() const {
+    return Symbol(static_cast<std::uint32_t>(m_bits));
+  }
+
+  /// The raw encoding, e.g. to use values as keys
+  [[nodiscard]] constexpr std::uint64_t bits() const {
+    return m_bits;
+  }
+
+  /// nil and false are falsey, everything else is truthy
+  [[nodiscard]] constexpr bool is_truthy() const {
+    return !is_nil() && m_bits != (quiet_nan | false_tag);
+  }
+
+  /// Lox equality: numbers compare as doubles, so NaN is not equal to itself,
+  /// and the other values are equal if they have the same type and contents
+  friend constexpr bool operator==(Value const lhs, Value const rhs) {
+    if (lhs.is_number() && rhs.is_number()) {
+      return lhs.as_number() == rhs.as_number();
+    }
+    return lhs.m_bits == rhs.m_bits;
+  }
+
+  /// The value as `print` shows it, e.g. `3` rather than `3.0`
+  [[nodiscard]] std::string to_string() const;
+};
+
+static_assert(sizeof(Value) == sizeof(double));
+
+#endif // VALUE_HPP
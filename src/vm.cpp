@@ -0,0 +1,189 @@
+#include <string>
+#include <string_view>
+
+#include "evaluator.hpp" // RuntimeError
+#include "interner.hpp"
+#include "vm.hpp"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CPPLOX_COMPUTED_GOTO 1
+#endif
+
+namespace {
+[[noreturn]] void runtime_error(
+    Chunk const &chunk,
+    std::uint8_t const *ip,
+    std::string_view const message) {
+  // ip is past the failing instruction, which has no operands
+  auto const offset = static_cast<std::size_t>(ip - chunk.code().data()) - 1;
+  throw RuntimeError(message, chunk.line(offset));
+}
+
+Value concatenate(Value const left, Value const right) {
+  auto &interner = Interner::global();
+  auto concatenation = std::string(interner.view(left.as_string()));
+  concatenation.append(interner.view(right.as_string()));
+  return Value(interner.intern(concatenation));
+}
+} // namespace
+
+#ifdef CPPLOX_COMPUTED_GOTO
+// taking the address of a label and jumping to it are GNU extensions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define VM_CASE(op) op_##op:
+#define VM_DISPATCH() goto *dispatch_table[*ip++]
+#else
+#define VM_CASE(op) case OpCode::op:
+#define VM_DISPATCH() continue
+#endif
+
+/// Pop the two operands of a binary operator that only takes numbers, and push
+/// `left oper right`
+#define VM_NUMERIC_BINARY(oper)                                                \
+  do {                                                                         \
+    auto const right = *--sp;                                                  \
+    auto const left = sp[-1];                                                  \
+    if (!left.is_number() || !right.is_number()) {                             \
+      runtime_error(chunk, ip, "Operands must be numbers.");                   \
+    }                                                                          \
+    sp[-1] = Value(left.as_number() oper right.as_number());                   \
+  } while (false)
+
+Value Vm::run(Chunk const &chunk) {
+  if (m_stack.size() < chunk.max_stack()) {
+    m_stack.resize(chunk.max_stack());
+  }
+  auto const *ip = chunk.code().data();
+  auto const *const constants = chunk.constants().data();
+  // points past the top of the stack
+  auto *sp = m_stack.data();
+
+#ifdef CPPLOX_COMPUTED_GOTO
+  // in the order of OpCode
+  static void *const dispatch_table[] = {
+      &&op_CONSTANT,
+      &&op_CONSTANT_LONG,
+      &&op_NIL,
+      &&op_TRUE,
+      &&op_FALSE,
+      &&op_EQUAL,
+      &&op_NOT_EQUAL,
+      &&op_GREATER,
+      &&op_GREATER_EQUAL,
+      &&op_LESS,
+      &&op_LESS_EQUAL,
+      &&op_ADD,
+      &&op_SUBTRACT,
+      &&op_MULTIPLY,
+      &&op_DIVIDE,
+      &&op_NOT,
+      &&op_NEGATE,
+      &&op_RETURN};
+  static_assert(std::size(dispatch_table) == num_opcodes);
+  VM_DISPATCH();
+#else
+  while (true) {
+    switch (static_cast<OpCode>(*ip++)) {
+#endif
+
+  VM_CASE(CONSTANT) {
+    *sp++ = constants[*ip++];
+    VM_DISPATCH();
+  }
+  VM_CASE(CONSTANT_LONG) {
+    auto const index = std::size_t{ip[0]} | (std::size_t{ip[1]} << 8U)
+        | (std::size_t{ip[2]} << 16U);
+    ip += 3;
+    *sp++ = constants[index];
+    VM_DISPATCH();
+  }
+  VM_CASE(NIL) {
+    *sp++ = Value();
+    VM_DISPATCH();
+  }
+  VM_CASE(TRUE) {
+    *sp++ = Value(true);
+    VM_DISPATCH();
+  }
+  VM_CASE(FALSE) {
+    *sp++ = Value(false);
+    VM_DISPATCH();
+  }
+  VM_CASE(EQUAL) {
+    auto const right = *--sp;
+    sp[-1] = Value(sp[-1] == right);
+    VM_DISPATCH();
+  }
+  VM_CASE(NOT_EQUAL) {
+    auto const right = *--sp;
+    sp[-1] = Value(!(sp[-1] == right));
+    VM_DISPATCH();
+  }
+  VM_CASE(GREATER) {
+    VM_NUMERIC_BINARY(>);
+    VM_DISPATCH();
+  }
+  VM_CASE(GREATER_EQUAL) {
+    VM_NUMERIC_BINARY(>=);
+    VM_DISPATCH();
+  }
+  VM_CASE(LESS) {
+    VM_NUMERIC_BINARY(<);
+    VM_DISPATCH();
+  }
+  VM_CASE(LESS_EQUAL) {
+    VM_NUMERIC_BINARY(<=);
+    VM_DISPATCH();
+  }
+  VM_CASE(ADD) {
+    auto const right = *--sp;
+    auto const left = sp[-1];
+    if (left.is_number() && right.is_number()) {
+      sp[-1] = Value(left.as_number() + right.as_number());
+    } else if (left.is_string() && right.is_string()) {
+      sp[-1] = concatenate(left, right);
+    } else {
+      runtime_error(chunk, ip, "Operands must be two numbers or two strings.");
+    }
+    VM_DISPATCH();
+  }
+  VM_CASE(SUBTRACT) {
+    VM_NUMERIC_BINARY(-);
+    VM_DISPATCH();
+  }
+  VM_CASE(MULTIPLY) {
+    VM_NUMERIC_BINARY(*);
+    VM_DISPATCH();
+  }
+  VM_CASE(DIVIDE) {
+    VM_NUMERIC_BINARY(/);
+    VM_DISPATCH();
+  }
+  VM_CASE(NOT) {
+    sp[-1] = Value(!sp[-1].is_truthy());
+    VM_DISPATCH();
+  }
+  VM_CASE(NEGATE) {
+    if (!sp[-1].is_number()) {
+      runtime_error(chunk, ip, "Operand must be a number.");
+    }
+    sp[-1] = Value(-sp[-1].as_number());
+    VM_DISPATCH();
+  }
+  VM_CASE(RETURN) {
+    return sp[-1];
+  }
+
+#ifndef CPPLOX_COMPUTED_GOTO
+    }
+  }
+#endif
+}
+
+#undef VM_NUMERIC_BINARY
+#undef VM_DISPATCH
+#undef VM_CASE
+#ifdef CPPLOX_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,25 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+#include <vector>
+
+#include "chunk.hpp"
+#include "value.hpp"
+
+/// A stack machine that runs the bytecode of a Chunk. Type errors are thrown
+/// as RuntimeError, with the line of the failing instruction.
+///
+/// Under GCC and Clang the instructions are dispatched with computed gotos,
+/// i.e. every handler jumps straight to the next one through a table of label
+/// addresses, which gives the branch predictor one indirect jump per handler
+/// to learn from instead of a single shared one. Elsewhere a `switch` is used.
+class Vm {
+private:
+  std::vector<Value> m_stack;
+
+public:
+  /// Run `chunk` and return the value it returns
+  Value run(Chunk const &chunk);
+};
+
+#endif // VM_HPP
@@ -0,0 +1,619 @@
+// Front-end benchmarks over synthetic corpora.
+//
+// Usage: bench [--size MB] [--mix NAME]... [--reps N] [--seed N] [--output FILE]
+//
+// Every corpus is a single Lox expression of roughly the requested size, made
+// of flat chains of up to `chain_length` operands that are combined pairwise in
+// parentheses, so that the parser and the printer never recurse too deep. The
+// results are written as JSON, to stdout by default.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include <limits>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <sysexits.h> // EX_USAGE, EX_CANTCREAT
+#include <unistd.h> // dup, dup2
+#include <vector>
+
+#include "compiler.hpp"
+#include "diagnostics.hpp"
+#include "evaluator.hpp"
+#include "jit.hpp"
+#include "parser.hpp"
+#include "scan_kernels.hpp"
+#include "scanner.hpp"
+#include "vm.hpp"
+
+namespace {
+std::atomic<std::size_t> num_allocations{0};
+} // namespace
+
+void *operator new(std::size_t const size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto *const ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t const size) {
+  return operator new(size);
+}
+
+void operator delete(void *const ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *const ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *const ptr, std::size_t /*size*/) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *const ptr, std::size_t /*size*/) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+enum class Mix : std::uint8_t {
+  OPERATORS,
+  IDENTIFIERS,
+  STRINGS,
+  PARENS,
+  ARITHMETIC,
+  MALFORMED,
+};
+
+constexpr std::array mix_names{
+    std::string_view{"operators"},
+    std::string_view{"identifiers"},
+    std::string_view{"strings"},
+    std::string_view{"parens"},
+    std::string_view{"arithmetic"},
+    std::string_view{"malformed"}};
+
+struct Corpus {
+  std::string source;
+  std::size_t num_nodes{}; // of its expression tree, counting each pair of parentheses as a node
+  bool parsable{};
+  bool evaluable{}; // without runtime errors
+  std::size_t num_syntax_errors{};
+};
+
+constexpr std::size_t chain_length = 64;
+constexpr std::size_t paren_depth = 32;
+
+/// Generates the operands and operators of a corpus
+class CorpusGenerator {
+private:
+  Mix m_mix;
+  std::mt19937 m_gen;
+
+public:
+  CorpusGenerator(Mix const mix, std::uint32_t const seed)
+      : m_mix(mix),
+        m_gen(seed) {}
+
+  /// Append an operand to `source` and return the number of its AST nodes
+  std::size_t operand(std::string &source) {
+    switch (m_mix) {
+    case Mix::OPERATORS: {
+      static constexpr std::array<std::string_view, 3> unary_operators{
+          "", "-", "!"};
+      auto const &oper = unary_operators[pick(unary_operators.size())];
+      source.append(oper).push_back(static_cast<char>('0' + pick(10)));
+      return oper.empty() ? 1 : 2;
+    }
+    case Mix::IDENTIFIERS: {
+      static constexpr std::array<std::string_view, 4> keywords{
+          "true", "false", "nil", "this"};
+      if (pick(4) == 0) {
+        source.append(keywords[pick(keywords.size())]);
+        return 1;
+      }
+      auto const length = 3 + pick(10);
+      for (std::size_t i = 0; i < length; ++i) {
+        source.push_back(static_cast<char>('a' + pick(26)));
+      }
+      return 1;
+    }
+    case Mix::STRINGS: {
+      auto const length = 8 + pick(32);
+      source.push_back('"');
+      for (std::size_t i = 0; i < length; ++i) {
+        source.push_back(pick(6) == 0 ? ' ' : static_cast<char>('a' + pick(26)));
+      }
+      source.push_back('"');
+      return 1;
+    }
+    case Mix::PARENS: {
+      source.append(paren_depth, '(')
+          .append(std::to_string(pick(1000)))
+          .append(paren_depth, ')');
+      return paren_depth + 1;
+    }
+    case Mix::MALFORMED: {
+      source.push_back(static_cast<char>('0' + pick(10)));
+      return 1;
+    }
+    case Mix::ARITHMETIC: {
+      auto const negate = pick(4) == 0;
+      if (negate) {
+        source.push_back('-');
+      }
+      source.push_back(static_cast<char>('1' + pick(9)));
+      return negate ? 2 : 1;
+    }
+    }
+    return 0;
+  }
+
+  /// Append a binary operator to `source`
+  void binary_operator(std::string &source) {
+    static constexpr std::array<std::string_view, 10> binary_operators{
+        "+", "-", "*", "/", "<", "<=", ">", ">=", "==", "!="};
+    if (m_mix == Mix::OPERATORS) {
+      source.append(binary_operators[pick(binary_operators.size())]);
+    } else if (m_mix == Mix::ARITHMETIC || m_mix == Mix::MALFORMED) {
+      source.append(binary_operators[pick(4)]);
+    } else {
+      source.append(" + ");
+    }
+  }
+
+private:
+  std::size_t pick(std::size_t const count) {
+    return std::uniform_int_distribution<std::size_t>(0, count - 1)(m_gen);
+  }
+};
+
+/// Append the chains [first, last) of `chains`, combined pairwise in
+/// parentheses, and return the number of AST nodes added by the combining
+std::size_t combine(
+    std::string &source,
+    std::vector<std::string> const &chains,
+    std::size_t const first,
+    std::size_t const last,
+    CorpusGenerator &generator) {
+  if (last - first == 1) {
+    source.append(chains[first]);
+    return 0;
+  }
+
+  auto const mid = first + (last - first) / 2;
+  source.push_back('(');
+  auto num_nodes = combine(source, chains, first, mid, generator);
+  generator.binary_operator(source);
+  num_nodes += combine(source, chains, mid, last, generator);
+  source.append(")\n");
+  // a binary operator and a pair of parentheses
+  return num_nodes + 2;
+}
+
+Corpus generate(Mix const mix, std::size_t const size, std::uint32_t const seed) {
+  CorpusGenerator generator(mix, seed);
+  Corpus corpus;
+  corpus.parsable = mix != Mix::IDENTIFIERS; // there are no variables yet
+  // the operators mix mixes up booleans and numbers, and concatenating the
+  // strings mix would intern every intermediate string
+  corpus.evaluable = mix == Mix::PARENS || mix == Mix::ARITHMETIC;
+
+  std::vector<std::string> chains;
+  std::size_t chains_size = 0;
+  while (chains_size < size) {
+    std::string chain;
+    corpus.num_nodes += generator.operand(chain);
+    for (std::size_t i = 1; i < chain_length; ++i) {
+      generator.binary_operator(chain);
+      if (mix == Mix::MALFORMED && i == chain_length / 2) {
+        // an operand is missing, e.g. `1 + * 2`
+        chain.push_back('*');
+      }
+      corpus.num_nodes += generator.operand(chain) + 1;
+    }
+    if (mix == Mix::MALFORMED) {
+      // the parser resynchronizes past the semicolon
+      chain.push_back(';');
+      ++corpus.num_syntax_errors;
+    }
+    chain.push_back('\n');
+    chains_size += chain.size();
+    chains.push_back(std::move(chain));
+  }
+
+  if (mix == Mix::MALFORMED) {
+    // statements of their own, with one syntax error each
+    for (auto const &chain : chains) {
+      corpus.source.append(chain);
+    }
+    return corpus;
+  }
+
+  corpus.source.reserve(chains_size + chains.size() * 8);
+  corpus.num_nodes +=
+      combine(corpus.source, chains, 0, chains.size(), generator);
+  return corpus;
+}
+
+struct Measurement {
+  double seconds{std::numeric_limits<double>::infinity()}; // the fastest rep
+  std::size_t allocations{}; // in the last rep
+};
+
+/// Time `reps` runs of `func`, which returns the number of allocations it made
+template <typename Func>
+Measurement measure(std::size_t const reps, Func func) {
+  Measurement result;
+  for (std::size_t rep = 0; rep < reps; ++rep) {
+    auto const start = std::chrono::steady_clock::now();
+    result.allocations = func();
+    std::chrono::duration<double> const elapsed =
+        std::chrono::steady_clock::now() - start;
+    result.seconds = std::min(result.seconds, elapsed.count());
+  }
+  return result;
+}
+
+double per(double const amount, double const seconds) {
+  return seconds > 0 ? amount / seconds : 0;
+}
+
+double per(std::size_t const amount, double const seconds) {
+  return per(static_cast<double>(amount), seconds);
+}
+
+double per(std::size_t const amount, std::size_t const count) {
+  return count > 0 ? static_cast<double>(amount) / static_cast<double>(count)
+                   : 0;
+}
+
+/// Parse a corpus of syntax errors. They are collected, and written on stderr
+/// in one go, which is muted meanwhile.
+std::string bench_syntax_errors(
+    Corpus const &corpus,
+    std::size_t const reps,
+    double const megabytes,
+    std::size_t const num_tokens) {
+  std::fflush(stderr);
+  auto const saved_fd = dup(fileno(stderr));
+  auto *const null = std::fopen("/dev/null", "w");
+  dup2(fileno(null), fileno(stderr));
+
+  std::size_t num_errors = 0;
+  auto const parse = measure(reps, [&] {
+    auto const before = num_allocations.load(std::memory_order_relaxed);
+    DiagnosticSink diagnostics(corpus.source);
+    Scanner scanner(corpus.source, diagnostics);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    num_errors = parser.errors().size();
+    diagnostics.flush(stderr);
+    return num_allocations.load(std::memory_order_relaxed) - before;
+  });
+
+  std::fflush(stderr);
+  dup2(saved_fd, fileno(stderr));
+  close(saved_fd);
+  std::fclose(null);
+
+  if (num_errors != corpus.num_syntax_errors) {
+    fmt::println(
+        stderr,
+        "Expected {} syntax errors, found {}",
+        corpus.num_syntax_errors,
+        num_errors);
+    std::exit(EXIT_FAILURE);
+  }
+  return fmt::format(
+      R"({{
+        "seconds": {:.6f},
+        "mb_per_s": {:.2f},
+        "tokens_per_s": {:.0f},
+        "errors": {},
+        "errors_per_s": {:.0f},
+        "allocations_per_token": {:.4f}
+      }}
+    }})",
+      parse.seconds,
+      per(megabytes, parse.seconds),
+      per(num_tokens, parse.seconds),
+      num_errors,
+      per(num_errors, parse.seconds),
+      per(parse.allocations, num_tokens));
+}
+
+std::string bench_mix(Mix const mix, Corpus const &corpus, std::size_t reps) {
+  auto const megabytes = static_cast<double>(corpus.source.size()) / 1e6;
+
+  std::size_t num_tokens = 0;
+  auto const scan = measure(reps, [&] {
+    auto const before = num_allocations.load(std::memory_order_relaxed);
+    Scanner scanner(corpus.source);
+    auto const tokens = scanner.scan_tokens();
+    num_tokens = tokens.size();
+    return num_allocations.load(std::memory_order_relaxed) - before;
+  });
+
+  auto json = fmt::format(
+      R"(    {{
+      "mix": "{}",
+      "bytes": {},
+      "tokens": {},
+      "scan": {{
+        "seconds": {:.6f},
+        "mb_per_s": {:.2f},
+        "tokens_per_s": {:.0f},
+        "allocations_per_token": {:.4f}
+      }},
+      "parse": )",
+      mix_names[static_cast<std::size_t>(mix)],
+      corpus.source.size(),
+      num_tokens,
+      scan.seconds,
+      per(megabytes, scan.seconds),
+      per(num_tokens, scan.seconds),
+      per(scan.allocations, num_tokens));
+
+  if (corpus.num_syntax_errors > 0) {
+    return json + bench_syntax_errors(corpus, reps, megabytes, num_tokens);
+  }
+  if (!corpus.parsable) {
+    return json + "null\n    }";
+  }
+
+  // the parser pulls its tokens from the scanner, so this includes scanning
+  std::size_t ast_bytes = 0;
+  auto const parse = measure(reps, [&] {
+    auto const before = num_allocations.load(std::memory_order_relaxed);
+    Scanner scanner(corpus.source);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    auto const allocations =
+        num_allocations.load(std::memory_order_relaxed) - before;
+    if (!ast) {
+      fmt::println(
+          stderr,
+          "The {} corpus doesn't parse",
+          mix_names[static_cast<std::size_t>(mix)]);
+      std::exit(EXIT_FAILURE);
+    }
+    ast_bytes = ast->memory_usage();
+    return allocations;
+  });
+
+  // printing walks the whole tree
+  Scanner scanner(corpus.source);
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  auto const print = measure(reps, [&] {
+    auto const before = num_allocations.load(std::memory_order_relaxed);
+    auto const printed = ast->to_string();
+    return num_allocations.load(std::memory_order_relaxed) - before;
+  });
+
+  auto eval_json = std::string("null");
+  if (corpus.evaluable) {
+    auto const eval = measure(reps, [&] {
+      auto const before = num_allocations.load(std::memory_order_relaxed);
+      auto const value = Evaluator(*ast, scanner.lines()).evaluate();
+      static_cast<void>(value.is_number());
+      return num_allocations.load(std::memory_order_relaxed) - before;
+    });
+    eval_json = fmt::format(
+        R"({{
+        "seconds": {:.6f},
+        "evaluations_per_s": {:.2f},
+        "nodes_per_s": {:.0f},
+        "allocations_per_node": {:.4f}
+      }})",
+        eval.seconds,
+        per(1.0, eval.seconds),
+        per(corpus.num_nodes, eval.seconds),
+        per(eval.allocations, corpus.num_nodes));
+  }
+
+  // the same expression compiled to bytecode, to compare with the evaluator
+  auto vm_json = std::string("null");
+  if (corpus.evaluable) {
+    std::optional<Chunk> chunk;
+    auto const compilation = measure(reps, [&] {
+      auto const before = num_allocations.load(std::memory_order_relaxed);
+      chunk = compile(*ast, scanner.lines());
+      return num_allocations.load(std::memory_order_relaxed) - before;
+    });
+    Vm vm;
+    auto const run = measure(reps, [&] {
+      auto const before = num_allocations.load(std::memory_order_relaxed);
+      auto const value = vm.run(*chunk);
+      static_cast<void>(value.is_number());
+      return num_allocations.load(std::memory_order_relaxed) - before;
+    });
+    vm_json = fmt::format(
+        R"({{
+        "compile_seconds": {:.6f},
+        "bytecode_bytes": {},
+        "seconds": {:.6f},
+        "evaluations_per_s": {:.2f},
+        "nodes_per_s": {:.0f},
+        "allocations_per_node": {:.4f}
+      }})",
+        compilation.seconds,
+        chunk->code().size(),
+        run.seconds,
+        per(1.0, run.seconds),
+        per(corpus.num_nodes, run.seconds),
+        per(run.allocations, corpus.num_nodes));
+  }
+
+  // and to machine code, when it's numeric
+  auto jit_json = std::string("null");
+  if (corpus.evaluable) {
+    std::optional<JitFunction> function;
+    auto const compilation = measure(reps, [&] {
+      auto const before = num_allocations.load(std::memory_order_relaxed);
+      function = JitFunction::compile(*ast);
+      return num_allocations.load(std::memory_order_relaxed) - before;
+    });
+    if (function) {
+      auto const run = measure(reps, [&] {
+        auto const before = num_allocations.load(std::memory_order_relaxed);
+        auto const value = function->run();
+        static_cast<void>(value.is_number());
+        return num_allocations.load(std::memory_order_relaxed) - before;
+      });
+      jit_json = fmt::format(
+          R"({{
+        "compile_seconds": {:.6f},
+        "code_bytes": {},
+        "seconds": {:.6f},
+        "evaluations_per_s": {:.2f},
+        "nodes_per_s": {:.0f},
+        "allocations_per_node": {:.4f}
+      }})",
+          compilation.seconds,
+          function->code_size(),
+          run.seconds,
+          per(1.0, run.seconds),
+          per(corpus.num_nodes, run.seconds),
+          per(run.allocations, corpus.num_nodes));
+    }
+  }
+
+  return json
+      + fmt::format(
+             R"({{
+        "seconds": {:.6f},
+        "mb_per_s": {:.2f},
+        "tokens_per_s": {:.0f},
+        "nodes": {},
+        "nodes_per_s": {:.0f},
+        "allocations_per_token": {:.4f},
+        "ast_bytes": {}
+      }},
+      "print": {{
+        "seconds": {:.6f},
+        "nodes_per_s": {:.0f},
+        "allocations_per_node": {:.4f}
+      }},
+      "eval": {},
+      "vm": {},
+      "jit": {}
+    }})",
+             parse.seconds,
+             per(megabytes, parse.seconds),
+             per(num_tokens, parse.seconds),
+             corpus.num_nodes,
+             per(corpus.num_nodes, parse.seconds),
+             per(parse.allocations, num_tokens),
+             ast_bytes,
+             print.seconds,
+             per(corpus.num_nodes, print.seconds),
+             per(print.allocations, corpus.num_nodes),
+             eval_json,
+             vm_json,
+             jit_json);
+}
+
+[[noreturn]] void usage(char const *argv0) {
+  fmt::println(
+      stderr,
+      "Usage: {} [--size MB] "
+      "[--mix operators|identifiers|strings|parens|arithmetic|malformed]... "
+      "[--reps N] [--seed N] [--output FILE]",
+      argv0);
+  std::exit(EX_USAGE);
+}
+} // namespace
+
+int main(int argc, char const *const *argv) {
+  double size_mb = 4;
+  std::vector<Mix> mixes;
+  std::size_t reps = 5;
+  std::uint32_t seed = 42;
+  char const *output_path = nullptr;
+
+  for (int idx = 1; idx < argc; ++idx) {
+    std::string_view const arg = argv[idx];
+    if (idx + 1 == argc) {
+      usage(argv[0]);
+    }
+    char const *const value = argv[++idx];
+    if (arg == "--size") {
+      size_mb = std::atof(value);
+    } else if (arg == "--mix") {
+      auto const it = std::ranges::find(mix_names, value);
+      if (it == mix_names.end()) {
+        usage(argv[0]);
+      }
+      mixes.push_back(static_cast<Mix>(it - mix_names.begin()));
+    } else if (arg == "--reps") {
+      reps = std::max(1UL, std::strtoul(value, nullptr, 10));
+    } else if (arg == "--seed") {
+      seed = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+    } else if (arg == "--output") {
+      output_path = value;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (size_mb <= 0) {
+    usage(argv[0]);
+  }
+  if (mixes.empty()) {
+    mixes = {
+        Mix::OPERATORS,
+        Mix::IDENTIFIERS,
+        Mix::STRINGS,
+        Mix::PARENS,
+        Mix::ARITHMETIC,
+        Mix::MALFORMED};
+  }
+
+  auto const size = static_cast<std::size_t>(size_mb * 1e6);
+  std::vector<std::string> results;
+  for (auto const mix : mixes) {
+    auto const corpus = generate(mix, size, seed);
+    results.push_back(bench_mix(mix, corpus, reps));
+  }
+
+  auto *output = stdout;
+  if (output_path != nullptr) {
+    output = std::fopen(output_path, "w");
+    if (output == nullptr) {
+      fmt::println(stderr, "Could not open {} for writing", output_path);
+      return EX_CANTCREAT;
+    }
+  }
+  fmt::println(
+      output,
+      R"({{
+  "version": "{}",
+  "simd_level": {},
+  "reps": {},
+  "seed": {},
+  "results": [
+{}
+  ]
+}})",
+      CPPLOX_VERSION,
+      static_cast<int>(best_simd_level()),
+      reps,
+      seed,
+      fmt::join(results, ",\n"));
+  if (output != stdout) {
+    std::fclose(output);
+  }
+  return 0;
+}
@@ -1,13 +1,53 @@
 #include "parser.hpp"
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_string.hpp>
 #include <catch2/matchers/catch_matchers_vector.hpp>
 
-#include <expr.hpp>
+#include <ast.hpp>
+#include <ast_cache.hpp>
+#include <ast_visitor.hpp>
+#include <bit>
+#include <chrono>
+#include <chunk.hpp>
+#include <cmath>
+#include <compiler.hpp>
+#include <constant_folder.hpp>
+#include <cstdio>
+#include <diagnostics.hpp>
+#include <document.hpp>
+#include <evaluator.hpp>
+#include <filesystem>
+#include <fstream>
 #include <functional>
+#include <interner.hpp>
+#include <jit.hpp>
+#include <limits>
+#include <lox.hpp>
+#include <parallel_scanner.hpp>
+#include <random>
+#include <scan_kernels.hpp>
 #include <scanner.hpp>
+#include <source_file.hpp>
+#include <span>
+#include <stats.hpp>
+#include <stdexcept>
+#include <sysexits.h>
+#include <system_error>
+#include <thread>
+#include <thread_pool.hpp>
+#include <token_buffer.hpp>
+#include <token_cursor.hpp>
+#include <tracer.hpp>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <value.hpp>
+#include <vm.hpp>
 
-static constexpr std::vector<std::string>
-tokens_to_strings(std::vector<Token> const &tokens) {
+static std::vector<std::string>
+tokens_to_strings(TokenBuffer const &tokens) {
   std::vector<std::string> str_tokens;
   str_tokens.reserve(tokens.size());
   std::transform(
@@ -20,36 +60,30 @@ tokens_to_strings(std::vector<Token> const &tokens) {
 
 TEST_CASE("Scan number", "[scanner]") {
   Scanner scanner("1234\n");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(!scanner.had_error());
   REQUIRE(tokens.size() == 2);
   REQUIRE(tokens[0].literal_to_string() == "1234");
   REQUIRE(tokens[1].literal_to_string() == "EOF");
-
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
 }
 
 TEST_CASE("Scan number no new line", "[scanner]") {
   Scanner scanner("1234");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(!scanner.had_error());
   REQUIRE(tokens.size() == 2);
   REQUIRE(tokens[0].literal_to_string() == "1234");
   REQUIRE(tokens[1].literal_to_string() == "EOF");
-
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
 }
 
 TEST_CASE("Unexpected characters are skipped", "[scanner]") {
   Scanner scanner(R"(@
 #
 $^)");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(scanner.had_error());
   REQUIRE(tokens.size() == 1);
   REQUIRE(tokens[0].literal_to_string() == "EOF");
-
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
 }
 
 TEST_CASE("Comments", "[scanner]") {
@@ -57,13 +91,11 @@ TEST_CASE("Comments", "[scanner]") {
 // whole line comment
 1234 // trailing comment
 )");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(!scanner.had_error());
   REQUIRE(tokens.size() == 2);
   REQUIRE(tokens[0].literal_to_string() == "1234");
   REQUIRE(tokens[1].literal_to_string() == "EOF");
-
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
 }
 
 TEST_CASE("Operators", "[scanner]") {
@@ -71,7 +103,7 @@ TEST_CASE("Operators", "[scanner]") {
 !*+-/<><=>===!=
 ! * + - / < > <= >= == !=
 )");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(!scanner.had_error());
   REQUIRE(tokens.size() == 23);
 
@@ -81,8 +113,6 @@ TEST_CASE("Operators", "[scanner]") {
       Catch::Matchers::Equals(std::vector<std::string>(
           {"!", "*", "+", "-", "/", "<", ">",  "<=", ">=", "==", "!=", "!",
            "*", "+", "-", "/", "<", ">", "<=", ">=", "==", "!=", "EOF"})));
-
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
 }
 
 TEST_CASE("Strings", "[scanner]") {
@@ -95,7 +125,7 @@ TEST_CASE("Strings", "[scanner]") {
 "this is a multi
 line string"
 )");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(!scanner.had_error());
   REQUIRE(tokens.size() == 5);
 
@@ -108,13 +138,11 @@ line string"
            "\n\n",
            "this is a multi\nline string",
            "EOF"})));
-
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
 }
 
 TEST_CASE("Unterminated string", "[scanner]") {
   Scanner scanner(R"("this is an unterminated string)");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(scanner.had_error());
   REQUIRE(tokens.size() == 1);
 
@@ -122,8 +150,6 @@ TEST_CASE("Unterminated string", "[scanner]") {
   REQUIRE_THAT(
       str_tokens,
       Catch::Matchers::Equals(std::vector<std::string>({"EOF"})));
-
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
 }
 
 TEST_CASE("Numbers", "[scanner]") {
@@ -132,7 +158,7 @@ TEST_CASE("Numbers", "[scanner]") {
 123.000
 123.456
 )");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(!scanner.had_error());
   REQUIRE(tokens.size() == 4);
 
@@ -141,8 +167,35 @@ TEST_CASE("Numbers", "[scanner]") {
       str_tokens,
       Catch::Matchers::Equals(
           std::vector<std::string>({"123", "123", "123.456", "EOF"})));
+}
 
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
+TEST_CASE("Tokens that end the source", "[scanner]") {
+  for (auto const *source : {"!", "=", "<", ">", "/", "1", "1.", "a", "//"}) {
+    Scanner scanner(source);
+    TokenBuffer const tokens = scanner.scan_tokens();
+    REQUIRE(!scanner.had_error());
+    auto const str_tokens = tokens_to_strings(tokens);
+    if (std::string_view(source) == "//") {
+      REQUIRE(str_tokens == std::vector<std::string>{"EOF"});
+    } else if (std::string_view(source) == "1.") {
+      REQUIRE(str_tokens == std::vector<std::string>{"1", ".", "EOF"});
+    } else {
+      REQUIRE(str_tokens == std::vector<std::string>{source, "EOF"});
+    }
+  }
+}
+
+TEST_CASE("Dots around numbers", "[scanner]") {
+  Scanner scanner("1..2 .5 3.4.5 6.x_7");
+  TokenBuffer const tokens = scanner.scan_tokens();
+  REQUIRE(!scanner.had_error());
+
+  auto const str_tokens = tokens_to_strings(tokens);
+  REQUIRE_THAT(
+      str_tokens,
+      Catch::Matchers::Equals(std::vector<std::string>(
+          {"1", ".", ".", "2", ".", "5", "3.4", ".", "5", "6", ".", "x_7",
+           "EOF"})));
 }
 
 TEST_CASE("Identifiers", "[scanner]") {
@@ -172,7 +225,7 @@ CLASS
 classs
 CLASSS
 )");
-  std::vector<Token> const tokens = scanner.scan_tokens();
+  TokenBuffer const tokens = scanner.scan_tokens();
   REQUIRE(!scanner.had_error());
   REQUIRE(tokens.size() == 23);
 
@@ -184,35 +237,1846 @@ CLASSS
            "if",   "nil",   "or",     "print",  "return", "super",
            "this", "true",  "var",    "while",  "AND",    "And",
            "anD",  "CLASS", "classs", "CLASSS", "EOF"})));
+}
+
+TEST_CASE("Reserved words", "[token_type]") {
+  for (auto const &info : token_types) {
+    auto const is_keyword = info.type >= TokenType::AND
+        && info.type <= TokenType::WHILE;
+    REQUIRE(tt_to_string(info.type) == info.name);
+    if (!info.spelling.empty()) {
+      REQUIRE((keyword_type(info.spelling) == info.type) == is_keyword);
+    }
+  }
+  REQUIRE(tt_to_string(TokenType::LEFT_PAREN) == "LEFT_PAREN");
+  REQUIRE(keyword_type("") == TokenType::IDENTIFIER);
+  REQUIRE(keyword_type("f") == TokenType::IDENTIFIER);
+  REQUIRE(keyword_type("fn") == TokenType::IDENTIFIER);
+  REQUIRE(keyword_type("returns") == TokenType::IDENTIFIER);
+  REQUIRE(keyword_type("Nil") == TokenType::IDENTIFIER);
+}
+
+TEST_CASE("Lines and columns of tokens", "[scanner]") {
+  Scanner scanner("a\n  bc \"x\ny\" 1\n\n\t// comment\n  2");
+  TokenBuffer const tokens = scanner.scan_tokens();
+  REQUIRE(!scanner.had_error());
+  REQUIRE(tokens.size() == 6);
+
+  std::vector<std::pair<std::size_t, std::size_t>> positions;
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    positions.emplace_back(tokens.line(i), tokens.column(i));
+  }
+  REQUIRE(
+      positions
+      == std::vector<std::pair<std::size_t, std::size_t>>{
+          {1, 1}, {2, 3}, {2, 6}, {3, 4}, {6, 3}, {6, 4}});
+  REQUIRE(tokens.lexeme(2) == "\"x\ny\"");
+  REQUIRE(tokens[2].text() == "x\ny");
+  REQUIRE(tokens[3].number() == 1.0);
+  REQUIRE(tokens.lines() == scanner.lines());
+}
+
+TEST_CASE("Identifiers and strings are interned", "[scanner]") {
+  Scanner scanner(R"(foo bar foo "foo" "bar baz")");
+  TokenBuffer const tokens = scanner.scan_tokens();
+  REQUIRE(!scanner.had_error());
+  REQUIRE(tokens.size() == 6);
+
+  REQUIRE(tokens[0].symbol() == tokens[2].symbol());
+  REQUIRE(tokens[0].symbol() == tokens[3].symbol());
+  REQUIRE(tokens[0].symbol() != tokens[1].symbol());
+  REQUIRE(tokens[3].text() == "foo");
+  REQUIRE(tokens[4].text() == "bar baz");
+}
+
+TEST_CASE("Interner", "[interner]") {
+  Interner interner;
+  auto const empty = interner.intern("");
+  auto const abc = interner.intern("abc");
+  auto const large = interner.intern(std::string(100 * 1024, 'x'));
+  REQUIRE(interner.size() == 3);
+  REQUIRE(interner.intern("abc") == abc);
+  REQUIRE(interner.intern(std::string("abc")) == abc);
+  REQUIRE(interner.intern("") == empty);
+  REQUIRE(interner.view(empty).empty());
+  REQUIRE(interner.view(abc) == "abc");
+  REQUIRE(interner.view(large) == std::string(100 * 1024, 'x'));
+  REQUIRE(interner.size() == 3);
+}
+
+TEST_CASE("Interner is thread-safe", "[interner]") {
+  static constexpr std::size_t num_threads = 4;
+  static constexpr std::size_t num_strings = 10'000;
+
+  Interner interner;
+  std::vector<std::vector<Symbol>> symbols(num_threads);
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&interner, &symbols = symbols[t]]() {
+      for (std::size_t i = 0; i < num_strings; ++i) {
+        symbols.push_back(interner.intern(std::to_string(i)));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  REQUIRE(interner.size() == num_strings);
+  for (std::size_t t = 1; t < num_threads; ++t) {
+    REQUIRE(symbols[t] == symbols[0]);
+  }
+  for (std::size_t i = 0; i < num_strings; ++i) {
+    REQUIRE(interner.view(symbols[0][i]) == std::to_string(i));
+  }
+}
+
+static std::vector<SimdLevel> supported_simd_levels() {
+  std::vector<SimdLevel> levels;
+  for (auto level : {SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2}) {
+    if (level <= best_simd_level()) {
+      levels.push_back(level);
+    }
+  }
+  return levels;
+}
+
+TEST_CASE("Scan kernels agree with the scalar ones", "[scanner]") {
+  // a mix of the bytes the kernels look for, so that runs end at every
+  // possible offset inside a SIMD block
+  std::mt19937 gen(42);
+  std::discrete_distribution<std::size_t> pick({8, 2, 1, 1, 2, 1, 3});
+  static constexpr std::string_view alphabet = " \t\r\n\"/a";
+  std::string source;
+  for (std::size_t i = 0; i < 4096; ++i) {
+    source.push_back(alphabet[pick(gen)]);
+  }
+
+  use_simd_level(SimdLevel::SCALAR);
+  auto const scalar = scan_kernels();
+  for (auto const level : supported_simd_levels()) {
+    INFO("SIMD level " << static_cast<int>(level));
+    use_simd_level(level);
+    auto const &kernels = scan_kernels();
+    for (std::size_t pos = 0; pos <= source.size(); ++pos) {
+      REQUIRE(
+          kernels.find_line_end(source, pos)
+          == scalar.find_line_end(source, pos));
+
+      LineTable lines;
+      LineTable scalar_lines;
+      REQUIRE(
+          kernels.find_string_end(source, pos, lines)
+          == scalar.find_string_end(source, pos, scalar_lines));
+      REQUIRE(lines == scalar_lines);
+      REQUIRE(
+          kernels.skip_whitespace(source, pos, lines)
+          == scalar.skip_whitespace(source, pos, scalar_lines));
+      REQUIRE(lines == scalar_lines);
+    }
+  }
+  use_simd_level(best_simd_level());
+}
+
+TEST_CASE("Scanner gives the same tokens on every SIMD level", "[scanner]") {
+  std::string source;
+  for (std::size_t i = 0; i < 64; ++i) {
+    source.append(i, ' ')
+        .append("// a comment that is long enough to span a few SIMD blocks\n")
+        .append("\"a string\n")
+        .append(i, 'x')
+        .append("\nspanning lines\" 12.5\t\r\n")
+        .append(i % 7, '\n');
+  }
+
+  std::vector<std::vector<std::string>> results;
+  for (auto const level : supported_simd_levels()) {
+    use_simd_level(level);
+    Scanner scanner(source.c_str());
+    TokenBuffer const tokens = scanner.scan_tokens();
+    REQUIRE(!scanner.had_error());
+    REQUIRE(tokens.size() == 129);
+
+    std::vector<std::string> result;
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+      result.push_back(tokens[i].to_string(tokens.lines()));
+    }
+    results.push_back(std::move(result));
+  }
+  use_simd_level(best_simd_level());
+
+  for (auto const &result : results) {
+    REQUIRE(result == results.front());
+  }
+}
+
+/// Run `func` and return what it wrote to stderr
+template <typename Func>
+static std::string capture_stderr(Func func) {
+  std::fflush(stderr);
+  auto *const file = std::tmpfile();
+  auto const saved_fd = dup(fileno(stderr));
+  dup2(fileno(file), fileno(stderr));
+  func();
+  std::fflush(stderr);
+  dup2(saved_fd, fileno(stderr));
+  close(saved_fd);
+
+  std::string output(static_cast<std::size_t>(std::ftell(file)), '\0');
+  std::rewind(file);
+  auto const num_read = std::fread(output.data(), 1, output.size(), file);
+  output.resize(num_read);
+  std::fclose(file);
+  return output;
+}
+
+/// A directory of its own for a test, which is removed with everything in it
+/// at the end of the test, even when it fails
+class TempDirectory {
+private:
+  std::filesystem::path m_path;
+
+public:
+  explicit TempDirectory(std::string_view const name)
+      : m_path(
+            std::filesystem::temp_directory_path()
+            / fmt::format("cpplox_{}_{}", name, getpid())) {
+    std::filesystem::create_directories(m_path);
+  }
+  ~TempDirectory() {
+    std::error_code ignored;
+    std::filesystem::remove_all(m_path, ignored);
+  }
+  TempDirectory(TempDirectory const &) = delete;
+  TempDirectory &operator=(TempDirectory const &) = delete;
+
+  [[nodiscard]] std::filesystem::path const &path() const {
+    return m_path;
+  }
+  /// The path of `name` in the directory
+  [[nodiscard]] std::filesystem::path
+  operator/(std::filesystem::path const &name) const {
+    return m_path / name;
+  }
+};
+
+static std::vector<std::string> token_dump(TokenBuffer const &tokens) {
+  std::vector<std::string> dump;
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    dump.push_back(fmt::format(
+        "{}:{}: {} {}",
+        tokens.line(i),
+        tokens.column(i),
+        tokens[i].to_string(tokens.lines()),
+        tokens[i].literal_to_string()));
+  }
+  return dump;
+}
+
+TEST_CASE("Thread pool runs every task once", "[thread_pool]") {
+  for (std::size_t const num_threads : {1U, 2U, 8U}) {
+    ThreadPool pool(num_threads);
+    REQUIRE(pool.size() == num_threads);
+    for (std::size_t const num_tasks : {0U, 1U, 5U, 100U}) {
+      std::vector<std::atomic<int>> counts(num_tasks);
+      pool.run(num_tasks, [&](std::size_t const idx) { ++counts[idx]; });
+      for (auto const &count : counts) {
+        REQUIRE(count == 1);
+      }
+    }
+  }
+}
+
+TEST_CASE("Thread pool balances uneven tasks", "[thread_pool]") {
+  // the first share is much longer than the others, and gets stolen from
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> counts(1000);
+  pool.run(counts.size(), [&](std::size_t const idx) {
+    if (idx < counts.size() / 4) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    ++counts[idx];
+  });
+  for (auto const &count : counts) {
+    REQUIRE(count == 1);
+  }
+}
 
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
+TEST_CASE("Thread pool rethrows the exceptions of tasks", "[thread_pool]") {
+  for (std::size_t const num_threads : {1U, 4U}) {
+    ThreadPool pool(num_threads);
+    std::atomic<std::size_t> num_run{};
+    REQUIRE_THROWS_AS(
+        pool.run(
+            1000,
+            [&](std::size_t const idx) {
+              ++num_run;
+              if (idx % 100 == 7) {
+                throw std::length_error("too long");
+              }
+            }),
+        std::length_error);
+    // the tasks after the one that threw are skipped
+    if (num_threads == 1) {
+      REQUIRE(num_run == 8);
+    } else {
+      REQUIRE(num_run < 1000);
+    }
+    // the pool is still usable
+    std::vector<std::atomic<int>> counts(100);
+    pool.run(counts.size(), [&](std::size_t const idx) { ++counts[idx]; });
+    for (auto const &count : counts) {
+      REQUIRE(count == 1);
+    }
+  }
+}
+
+TEST_CASE("Parallel scanner matches the sequential one", "[scanner]") {
+  static constexpr std::array<std::string_view, 16> pieces = {
+      "foo",
+      " ",
+      "\n",
+      "12.5",
+      "!=",
+      "// a \"comment\" with a quote\n",
+      "\"a string // not a comment\"",
+      "\"a string\nspanning\n\nlines\"",
+      "\"",
+      "@",
+      "while",
+      "/",
+      "1.",
+      "\t\r\n  ",
+      "// the last line",
+      "\n\"\n\n\n\n\n\n\n\n\""};
+  std::mt19937 gen(1234);
+  std::uniform_int_distribution<std::size_t> pick(0, pieces.size() - 1);
+
+  for (std::size_t round = 0; round < 50; ++round) {
+    std::string source;
+    for (std::size_t i = 0; i < 100; ++i) {
+      source.append(pieces[pick(gen)]);
+    }
+
+    bool had_error{};
+    std::vector<std::string> expected;
+    LineTable expected_lines;
+    auto const expected_errors = capture_stderr([&] {
+      Scanner scanner(source);
+      auto const tokens = scanner.scan_tokens();
+      had_error = scanner.had_error();
+      expected = token_dump(tokens);
+      expected_lines = tokens.lines();
+    });
+
+    for (std::size_t const num_threads : {1U, 3U}) {
+      ThreadPool pool(num_threads);
+      for (std::size_t const chunk_size : {1U, 7U, 64U, 1U << 20U}) {
+        ParallelScanner scanner(source, pool, chunk_size);
+        std::optional<TokenBuffer> tokens;
+        auto const errors =
+            capture_stderr([&] { tokens.emplace(scanner.scan_tokens()); });
+        REQUIRE(scanner.had_error() == had_error);
+        REQUIRE(token_dump(*tokens) == expected);
+        REQUIRE(tokens->lines() == expected_lines);
+        REQUIRE(errors == expected_errors);
+
+        // a sink of the caller gets the errors, and nothing goes to stderr
+        DiagnosticSink diagnostics(source);
+        ParallelScanner reporting(source, pool, diagnostics, chunk_size);
+        REQUIRE(capture_stderr([&] {
+                  static_cast<void>(reporting.scan_tokens());
+                }).empty());
+        fmt::memory_buffer reported;
+        diagnostics.format(reported, DiagnosticFormat::TEXT);
+        REQUIRE(fmt::to_string(reported) == expected_errors);
+      }
+    }
+  }
+}
+
+TEST_CASE("Tokens are scanned on demand", "[scanner]") {
+  Scanner scanner("1 + foo");
+  REQUIRE(scanner.next_token().literal_to_string() == "1");
+  REQUIRE(scanner.next_token().literal_to_string() == "+");
+  REQUIRE(scanner.next_token().literal_to_string() == "foo");
+  REQUIRE(scanner.next_token().type() == TokenType::END_OF_FILE);
+  REQUIRE(scanner.next_token().type() == TokenType::END_OF_FILE);
+}
+
+TEST_CASE("Token cursor", "[scanner]") {
+  Scanner scanner("a b c d e f");
+  TokenCursor cursor(scanner);
+  REQUIRE(cursor.peek().literal_to_string() == "a");
+  REQUIRE(cursor.peek(TokenCursor::max_lookahead).literal_to_string() == "c");
+
+  std::vector<std::string> consumed;
+  while (cursor.peek().type() != TokenType::END_OF_FILE) {
+    cursor.advance();
+    consumed.push_back(cursor.previous().literal_to_string());
+  }
+  REQUIRE(
+      consumed == std::vector<std::string>{"a", "b", "c", "d", "e", "f"});
+  REQUIRE(cursor.peek(TokenCursor::max_lookahead).type()
+          == TokenType::END_OF_FILE);
+}
+
+TEST_CASE("Embedded NUL characters are scanned", "[scanner]") {
+  static constexpr std::string_view source("1 \0 2", 5);
+  Scanner scanner(source);
+  TokenBuffer const tokens = scanner.scan_tokens();
+  REQUIRE(scanner.had_error());
+  REQUIRE(tokens_to_strings(tokens) == std::vector<std::string>{"1", "2", "EOF"});
+}
+
+TEST_CASE("Source files", "[source_file]") {
+  TempDirectory const dir("source_file");
+  auto const path = dir / "script.lox";
+  static constexpr std::string_view contents("1 + \0 2\n", 8);
+
+  SECTION("regular files are read with their NULs") {
+    std::ofstream(path, std::ios::binary)
+        .write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    SourceFile const source(path.c_str());
+    REQUIRE(source.contents() == contents);
+  }
+
+  SECTION("empty files are empty") {
+    std::ofstream{path};
+    SourceFile const source(path.c_str());
+    REQUIRE(source.contents().empty());
+  }
+
+  SECTION("pipes are read until EOF") {
+    std::array<int, 2> fds{};
+    REQUIRE(pipe(fds.data()) == 0);
+    REQUIRE(
+        write(fds[1], contents.data(), contents.size())
+        == static_cast<ssize_t>(contents.size()));
+    close(fds[1]);
+    SourceFile const source(fmt::format("/dev/fd/{}", fds[0]).c_str());
+    close(fds[0]);
+    REQUIRE(source.contents() == contents);
+  }
+
+  SECTION("missing files and directories can't be read") {
+    REQUIRE_THROWS_AS(SourceFile(path.c_str()), std::system_error);
+    REQUIRE_THROWS_AS(SourceFile(dir.path().c_str()), std::system_error);
+
+    Lox lox;
+    REQUIRE(lox.run_file(path.c_str()) == EX_NOINPUT);
+  }
+
+  SECTION("sources over 4GiB are errors") {
+    std::ofstream{path};
+    std::filesystem::resize_file(path, std::uint64_t{1} << 32U);
+    Lox lox;
+    int status = 0;
+    auto const errors =
+        capture_stderr([&] { status = lox.run_file(path.c_str()); });
+    REQUIRE(status == EX_DATAERR);
+    REQUIRE(errors == "Error: Sources larger than 4GiB are not supported\n");
+  }
 }
 
 TEST_CASE("Pretty printer", "[printer]") {
   // -123 * (45.67) * "asd"
-  auto const expr = std::unique_ptr<Expr>(new Binary(
-      new Binary(
-          new Unary(
-              Token(TokenType::MINUS, "-", nullptr, 1),
-              new NumericLiteral(123.0)),
-          Token(TokenType::STAR, "*", nullptr, 1),
-          new Grouping(new NumericLiteral(45.67))),
-      Token(TokenType::STAR, "*", nullptr, 1),
-      new StringLiteral("asd")));
-  fmt::println("{}", expr->to_string());
-  REQUIRE(expr->to_string() == "(* (* (- 123) (group 45.67)) \"asd\")");
+  Ast ast;
+  auto const minus =
+      ast.add_unary(TokenType::MINUS, 0, ast.add_number(1, 123.0));
+  auto const group = ast.add_number(8, 45.67);
+  REQUIRE(ast.add_group(group));
+  auto const product = ast.add_binary(TokenType::STAR, 5, minus, group);
+  auto const str = ast.add_string(17, Interner::global().intern("asd"));
+  ast.add_binary(TokenType::STAR, 15, product, str);
+  fmt::println("{}", ast.to_string());
+  REQUIRE(ast.to_string() == "(* (* (- 123) (group 45.67)) \"asd\")");
 }
 
 TEST_CASE("Parser", "[parser]") {
   static constexpr auto source = R"src(!!(-123 * (45.67) * "asd") == ("abc" != 42.42))src";
   Scanner scanner(source);
-  std::vector<Token> tokens = scanner.scan_tokens();
+  Parser parser(scanner);
+  auto const ast = parser.parse();
   REQUIRE(!scanner.had_error());
+  REQUIRE(ast);
+  fmt::println("{}", ast->to_string());
+  REQUIRE(ast->to_string() == R"dst((== (! (! (group (* (* (- 123) (group 45.67)) "asd")))) (group (!= "abc" 42.42))))dst");
+}
+
+/// Counts the nodes of each kind under a node, to check the visitor dispatch
+class NodeCounter : public AstVisitor<NodeCounter, std::size_t> {
+public:
+  std::array<std::size_t, 6> counts{};
+
+  using AstVisitor::AstVisitor;
+
+  std::size_t visit_binary(NodeIndex const idx, Node const & /*node*/) {
+    ++counts[0];
+    return 1 + visit(m_ast.left(idx)) + visit(Ast::right(idx));
+  }
+  std::size_t visit_unary(NodeIndex const idx, Node const & /*node*/) {
+    ++counts[1];
+    return 1 + visit(Ast::operand(idx));
+  }
+  std::size_t visit_number(NodeIndex /*idx*/, Node const & /*node*/) {
+    ++counts[2];
+    return 1;
+  }
+  std::size_t visit_string(NodeIndex /*idx*/, Node const & /*node*/) {
+    ++counts[3];
+    return 1;
+  }
+  std::size_t visit_bool(NodeIndex /*idx*/, Node const & /*node*/) {
+    ++counts[4];
+    return 1;
+  }
+  std::size_t visit_nil(NodeIndex /*idx*/, Node const & /*node*/) {
+    ++counts[5];
+    return 1;
+  }
+};
+
+TEST_CASE("AST visitor", "[parser]") {
+  Scanner scanner(R"src(-(1 + 2) * "a" == !true != nil + false)src");
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+
+  NodeCounter counter(*ast);
+  REQUIRE(counter.visit(ast->root()) == ast->size());
+  REQUIRE(counter.counts == std::array<std::size_t, 6>{5, 2, 2, 1, 2, 1});
+}
+
+TEST_CASE("Printing deep trees", "[printer]") {
+  static constexpr std::size_t depth = 2'000;
+  std::string source;
+  std::string expected;
+  for (std::size_t i = 0; i < depth; ++i) {
+    source.append("(-");
+    expected.append("(group (+ (- ");
+  }
+  source.append("1");
+  expected.append("1");
+  for (std::size_t i = 0; i < depth; ++i) {
+    source.append(" + 2)");
+    expected.append(") 2))");
+  }
+
+  Scanner scanner(source);
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+  REQUIRE(ast->to_string() == expected);
+}
+
+TEST_CASE("Operator precedence and associativity", "[parser]") {
+  std::vector<std::pair<std::string_view, std::string_view>> const cases = {
+      {"1 - 2 - 3", "(- (- 1 2) 3)"},
+      {"1 / 2 * 3", "(* (/ 1 2) 3)"},
+      {"1 + 2 * 3 - 4", "(- (+ 1 (* 2 3)) 4)"},
+      {"1 < 2 == 3 >= 4", "(== (< 1 2) (>= 3 4))"},
+      {"1 == 2 != 3", "(!= (== 1 2) 3)"},
+      {"-1 * -2", "(* (- 1) (- 2))"},
+      {"!!true == false", "(== (! (! true)) false)"},
+      {"-(1 + 2) / 3", "(/ (- (group (+ 1 2))) 3)"},
+      {"1 + 2 < 3 * 4 != nil", "(!= (< (+ 1 2) (* 3 4)) nil)"}};
+  for (auto const &[source, expected] : cases) {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    REQUIRE(ast);
+    REQUIRE(ast->to_string() == expected);
+  }
+
+  for (auto const source : {"1 +", "(1", "* 2", ""}) {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    REQUIRE(!parser.parse());
+  }
+}
+
+TEST_CASE("AST nodes are stored in post-order", "[parser]") {
+  Scanner scanner(R"src(-((1 + 2)) * "a" == !true != nil)src");
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+  REQUIRE(ast->size() == 11);
+
+  // children come before their parents, and the root comes last
+  std::vector<std::size_t> parents(ast->size(), 0);
+  for (NodeIndex idx = 0; idx < ast->size(); ++idx) {
+    auto const &node = ast->node(idx);
+    if (node.kind == NodeKind::BINARY) {
+      REQUIRE(ast->left(idx) < Ast::right(idx));
+      ++parents[ast->left(idx)];
+      ++parents[Ast::right(idx)];
+    } else if (node.kind == NodeKind::UNARY) {
+      ++parents[Ast::operand(idx)];
+    }
+  }
+  for (NodeIndex idx = 0; idx < ast->root(); ++idx) {
+    REQUIRE(parents[idx] == 1);
+  }
+  REQUIRE(parents[ast->root()] == 0);
+
+  // parentheses are counted by the node they enclose
+  REQUIRE(ast->node(2).oper == TokenType::PLUS);
+  REQUIRE(ast->node(2).groups == 2);
+
+  // the nodes remember where their tokens are
+  auto const &root = ast->node(ast->root());
+  REQUIRE(root.kind == NodeKind::BINARY);
+  REQUIRE(root.oper == TokenType::BANG_EQUAL);
+  REQUIRE(root.offset == 26);
+  REQUIRE(ast->number(ast->node(0)) == 1.0);
+  REQUIRE(ast->to_string() == R"((!= (== (* (- (group (group (+ 1 2)))) "a") (! true)) nil))");
+}
+
+TEST_CASE("Every syntax error is reported", "[parser]") {
+  static constexpr auto source = "1 + ;\n(2 * ;\n3 3; ) + 4; (5";
+  Scanner scanner(source);
+  Parser parser(scanner);
+  std::optional<Ast> ast;
+  auto const errors = capture_stderr([&] { ast = parser.parse(); });
+  REQUIRE(!ast);
+
+  std::vector<std::string> messages;
+  for (auto const &error : parser.errors()) {
+    messages.push_back(fmt::format(
+        "{} {}",
+        scanner.lines().line(error.token.offset()),
+        message(error.code)));
+  }
+  REQUIRE_THAT(
+      messages,
+      Catch::Matchers::Equals(std::vector<std::string>{
+          "1 Expected expression",
+          "2 Expected expression",
+          "3 Expected end of expression",
+          "3 Expected expression",
+          "3 Exprected ')' after expression"}));
+  REQUIRE(
+      errors
+      == "Error at line: 1: Expected expression:  at \";\"\n"
+         "Error at line: 2: Expected expression:  at \";\"\n"
+         "Error at line: 3: Expected end of expression:  at \"3\"\n"
+         "Error at line: 3: Expected expression:  at \")\"\n"
+         "Error at line: 3: Exprected ')' after expression:  at end\n");
+
+  // tokens after the expression aren't silently dropped
+  for (auto const *trailing : {"1 2", "1 + 2;", "(1) (2)"}) {
+    Scanner trailing_scanner(trailing);
+    Parser trailing_parser(trailing_scanner);
+    capture_stderr([&] { ast = trailing_parser.parse(); });
+    REQUIRE(!ast);
+    REQUIRE(trailing_parser.errors().size() == 1);
+    REQUIRE(
+        trailing_parser.errors()[0].code
+        == DiagnosticCode::EXPECTED_END_OF_EXPRESSION);
+  }
+}
+
+TEST_CASE("Diagnostics are collected and flushed in one go", "[diagnostics]") {
+  std::string_view const source = "1 + @\n(2 * \"a\tb";
+  DiagnosticSink diagnostics(source);
+  Scanner scanner(source, diagnostics);
+  Parser parser(scanner);
+  std::optional<Ast> ast;
+  // nothing is written until the diagnostics are flushed
+  REQUIRE(capture_stderr([&] { ast = parser.parse(); }).empty());
+  REQUIRE(!ast);
+  REQUIRE(diagnostics.diagnostics().size() == 3);
+  auto const &error = diagnostics.diagnostics()[0];
+  REQUIRE(error.code == DiagnosticCode::UNEXPECTED_CHARACTER);
+  REQUIRE(error.offset == 4);
+  REQUIRE(error.line == 1);
+  REQUIRE(!error.token);
+  REQUIRE(diagnostics.diagnostics()[2].token == TokenType::END_OF_FILE);
+
+  fmt::memory_buffer json;
+  diagnostics.format(json, DiagnosticFormat::JSON_LINES, "dir/a \"b\".lox");
+  REQUIRE(
+      fmt::to_string(json)
+      == R"({"file":"dir/a \"b\".lox","severity":"error","code":"unexpected-character","message":"Unexpected character","line":1,"column":5,"offset":4,"length":1,"text":"@"})"
+         "\n"
+         R"({"file":"dir/a \"b\".lox","severity":"error","code":"unterminated-string","message":"Unterminated string","line":2,"column":6,"offset":11,"length":4,"text":"\"a\tb"})"
+         "\n"
+         R"({"file":"dir/a \"b\".lox","severity":"error","code":"expected-expression","message":"Expected expression","line":2,"column":10,"offset":15,"length":0,"token":"END_OF_FILE","text":""})"
+         "\n");
+
+  auto const text = capture_stderr([&] { diagnostics.flush(stderr); });
+  REQUIRE(
+      text
+      == "Error at line: 1: Unexpected character: @\n"
+         "Error at line: 2: Unterminated string: \"a\tb\n"
+         "Error at line: 2: Expected expression:  at end\n");
+  REQUIRE(diagnostics.empty());
+}
+
+TEST_CASE("Constant folding", "[constant_folder]") {
+  std::vector<std::pair<std::string_view, std::string_view>> const cases = {
+      {"60 * 60 * 24", "86400"},
+      {"(1 + 2) * -(3 - 4)", "3"},
+      {"0.1 + 0.2", "0.30000000000000004"},
+      {"1 / 0", "inf"},
+      {"-1 / 0", "-inf"},
+      {"-0", "-0"},
+      {"0 / 0 == 0 / 0", "false"},
+      {"0 / 0 != 0 / 0", "true"},
+      {"-0 == 0", "true"},
+      {"1 < 2 == 2 <= 2", "true"},
+      {"3 > 4 != 4 >= 3", "true"},
+      {"!!true", "true"},
+      {"!nil", "true"},
+      {"!0", "false"},
+      {"!\"\"", "false"},
+      {"\"a\" + \"b\" + \"c\"", "\"abc\""},
+      {"\"ab\" == \"a\" + \"b\"", "true"},
+      {"nil == false", "false"},
+      {"nil == nil", "true"},
+      {"1 == \"1\"", "false"},
+      {"((((1))))", "1"},
+      // operations that fail at runtime are left as they are
+      {"1 + \"a\"", "(+ 1 \"a\")"},
+      {"-\"a\"", "(- \"a\")"},
+      {"1 < \"a\"", "(< 1 \"a\")"},
+      {"\"a\" - \"b\"", "(- \"a\" \"b\")"},
+      {"-nil * (2 + 3)", "(* (- nil) 5)"},
+      {"(true + 1) == (2 * 3)", "(== (+ true 1) 6)"}};
+  for (auto const &[source, expected] : cases) {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    REQUIRE(ast);
+    auto const folded = fold_constants(*ast);
+    INFO(source);
+    REQUIRE(folded.to_string() == expected);
+  }
+
+  // the sign of the NaN is left to the hardware
+  Scanner scanner("0 / 0");
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+  auto const folded = fold_constants(*ast);
+  REQUIRE(folded.size() == 1);
+  REQUIRE(std::isnan(folded.number(folded.node(0))));
+}
+
+TEST_CASE("Constant folding keeps offsets and counts nodes", "[constant_folder]") {
+  Scanner scanner("(1 + 2) * -nil == ((3))");
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+  REQUIRE(ast->size() == 8);
+  REQUIRE(ast->node_count() == 11);
+
+  auto const folded = fold_constants(*ast);
+  REQUIRE(folded.to_string() == "(== (* 3 (- nil)) 3)");
+  REQUIRE(folded.size() == 6);
+  REQUIRE(folded.node_count() == 6);
+  // a folded node takes the place of its operator
+  REQUIRE(folded.node(0).offset == 3);
+  REQUIRE(folded.node(folded.root()).offset == 15);
+}
+
+TEST_CASE("NaN-boxed values", "[evaluator]") {
+  auto const symbol = Interner::global().intern("boxed");
+  auto const nan = std::numeric_limits<double>::quiet_NaN();
+  auto const inf = std::numeric_limits<double>::infinity();
+
+  for (auto const number : {0.0, -0.0, 1.5, -1e308, inf, -inf, nan, -nan}) {
+    Value const value(number);
+    REQUIRE(value.is_number());
+    REQUIRE(!value.is_nil());
+    REQUIRE(!value.is_bool());
+    REQUIRE(!value.is_string());
+    REQUIRE(std::bit_cast<std::uint64_t>(value.as_number())
+            == std::bit_cast<std::uint64_t>(number));
+    REQUIRE(value.is_truthy());
+  }
+  // the NaN of 0 / 0, whatever its sign, is still a number
+  volatile double zero = 0.0;
+  REQUIRE(Value(zero / zero).is_number());
+  REQUIRE(Value(-(zero / zero)).is_number());
+
+  REQUIRE(Value().is_nil());
+  REQUIRE(!Value().is_truthy());
+  REQUIRE(Value(true).is_bool());
+  REQUIRE(Value(true).as_bool());
+  REQUIRE(Value(false).is_bool());
+  REQUIRE(!Value(false).as_bool());
+  REQUIRE(!Value(false).is_truthy());
+  REQUIRE(Value(symbol).is_string());
+  REQUIRE(!Value(symbol).is_number());
+  REQUIRE(Value(symbol).as_string() == symbol);
+
+  REQUIRE(Value(nan) != Value(nan));
+  REQUIRE(Value(0.0) == Value(-0.0));
+  REQUIRE(Value(symbol) == Value(Interner::global().intern("boxed")));
+  REQUIRE(Value() != Value(false));
+  REQUIRE(Value(1.0) != Value(true));
+}
+
+TEST_CASE("Evaluator", "[evaluator]") {
+  std::vector<std::pair<std::string_view, std::string_view>> const cases = {
+      {"1 + 2 * 3", "7"},
+      {"(1 + 2) * 3", "9"},
+      {"10 / 4", "2.5"},
+      {"0.1 + 0.2", "0.30000000000000004"},
+      {"1 / 0", "inf"},
+      {"0 / 0", "nan"},
+      {"-0", "-0"},
+      {"-(-3)", "3"},
+      {"1 < 2", "true"},
+      {"2 <= 1", "false"},
+      {"3 > 3", "false"},
+      {"3 >= 3", "true"},
+      {"0 / 0 == 0 / 0", "false"},
+      {"1 == 1 != false", "true"},
+      {"nil == nil", "true"},
+      {"nil == false", "false"},
+      {"1 == \"1\"", "false"},
+      {"\"a\" + \"b\" == \"ab\"", "true"},
+      {"\"con\" + \"cat\"", "concat"},
+      {"!nil", "true"},
+      {"!0", "false"},
+      {"!!\"\"", "true"},
+      {"nil", "nil"}};
+  for (auto const &[source, expected] : cases) {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    REQUIRE(ast);
+    INFO(source);
+    REQUIRE(Evaluator(*ast, scanner.lines()).evaluate().to_string() == expected);
+    // folding must not change the result
+    auto const folded = fold_constants(*ast);
+    REQUIRE(Evaluator(folded, scanner.lines()).evaluate().to_string() == expected);
+  }
+}
+
+TEST_CASE("Runtime errors", "[evaluator]") {
+  std::vector<std::tuple<std::string_view, std::string_view, std::size_t>> const
+      cases = {
+          {"1 +\n\"a\"", "Operands must be two numbers or two strings.", 1},
+          {"1 +\n\n(2 < \"a\")", "Operands must be numbers.", 3},
+          {"\n\n-\nnil", "Operand must be a number.", 3},
+          {"true * 2", "Operands must be numbers.", 1},
+          {"1 + 2\n+ nil", "Operands must be two numbers or two strings.", 2}};
+  for (auto const &[source, message, line] : cases) {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    REQUIRE(ast);
+    INFO(source);
+    try {
+      static_cast<void>(Evaluator(*ast, scanner.lines()).evaluate());
+      FAIL("no runtime error");
+    } catch (RuntimeError const &error) {
+      REQUIRE(error.what() == message);
+      REQUIRE(error.line() == line);
+    }
+  }
+
+  TempDirectory const dir("runtime_error");
+  auto const path = dir / "script.lox";
+  std::ofstream(path) << "1 +\n-\"a\"\n";
+  Lox lox;
+  int status = 0;
+  auto const errors = capture_stderr([&] { status = lox.run_file(path.c_str()); });
+  REQUIRE(status == EX_SOFTWARE);
+  REQUIRE(errors == "Operand must be a number.\n[line 2]\n");
+}
+
+TEST_CASE("Checking files in a batch", "[lox]") {
+  TempDirectory const root("check");
+  std::filesystem::create_directories(root / "sub");
+  std::vector<std::string> paths;
+  for (std::size_t idx = 0; idx < 200; ++idx) {
+    // every third file has errors, and so does the directory
+    auto const path = root / fmt::format("{:03}.lox", idx);
+    std::ofstream(path) << (idx % 3 == 0 ? "1 +\n* 2 @" : "(1 + 2) * 3");
+    paths.push_back(path.native());
+  }
+  std::ofstream(root / "sub" / "b.lox") << "(1";
+  std::ofstream(root / "sub" / "ignored.txt") << "(1";
+
+  std::string expected;
+  for (std::size_t idx = 0; idx < 200; idx += 3) {
+    expected += fmt::format(
+        "{0}: Error at line: 2: Unexpected character: @\n"
+        "{0}: Error at line: 2: Expected expression:  at \"*\"\n",
+        paths[idx]);
+  }
+  expected += fmt::format(
+      "{}: Error at line: 1: Exprected ')' after expression:  at end\n",
+      (root / "sub" / "b.lox").native());
+  expected += fmt::format(
+      "{0}: Could not read script: {0}: No such file or directory\n",
+      (root / "missing.lox").native());
+
+  std::vector<char const *> args;
+  for (auto const &path : paths) {
+    args.push_back(path.c_str());
+  }
+  auto const sub = (root / "sub").native();
+  auto const missing = (root / "missing.lox").native();
+  args.push_back(sub.c_str());
+  args.push_back(missing.c_str());
+
+  for (std::size_t const jobs : {1U, 4U}) {
+    LoxOptions options;
+    options.jobs = jobs;
+    Lox lox(options);
+    int status = 0;
+    auto const errors = capture_stderr([&] { status = lox.check_files(args); });
+    REQUIRE(status == EX_NOINPUT);
+    REQUIRE(errors == expected);
+
+    args.pop_back();
+    static_cast<void>(
+        capture_stderr([&] { status = lox.check_files(args); }));
+    REQUIRE(status == EX_DATAERR);
+    args.push_back(missing.c_str());
+  }
+
+  Lox lox;
+  REQUIRE(lox.check_files(std::span(args).subspan(1, 2)) == 0);
+
+  // a file too large to scan is an error of its own, and the others are
+  // still checked
+  auto const huge = root / "huge.lox";
+  std::ofstream{huge};
+  std::filesystem::resize_file(huge, std::uint64_t{1} << 32U);
+  std::array<char const *, 2> const huge_args{huge.c_str(), args[1]};
+  for (std::size_t const jobs : {1U, 2U}) {
+    LoxOptions options;
+    options.jobs = jobs;
+    Lox huge_lox(options);
+    int status = 0;
+    auto const errors =
+        capture_stderr([&] { status = huge_lox.check_files(huge_args); });
+    REQUIRE(status == EX_DATAERR);
+    REQUIRE(
+        errors
+        == fmt::format(
+            "{}: Error: Sources larger than 4GiB are not supported\n",
+            huge.native()));
+  }
+}
+
+/// A random expression over every operator and kind of literal, on several
+/// lines, for differential tests of the backends
+static std::string random_expression(std::mt19937 &gen, std::size_t depth) {
+  auto const pick = [&gen](std::size_t const count) {
+    return std::uniform_int_distribution<std::size_t>(0, count - 1)(gen);
+  };
+  if (depth == 0 || pick(4) == 0) {
+    static constexpr std::array<std::string_view, 10> literals{
+        "0", "1", "2.5", "-0", "nil", "true", "false", "\"a\"", "\"b\"", "7"};
+    return std::string(literals[pick(literals.size())]);
+  }
+  static constexpr std::array<std::string_view, 12> operators{
+      "+", "-", "*", "/", "<", "<=", ">", ">=", "==", "!=", "+\n", "*\n"};
+  switch (pick(3)) {
+  case 0: {
+    return fmt::format("{}({})", pick(2) == 0 ? "-" : "!", random_expression(gen, depth - 1));
+  }
+  default: {
+    auto const left = random_expression(gen, depth - 1);
+    auto const right = random_expression(gen, depth - 1);
+    return fmt::format("({} {} {})", left, operators[pick(operators.size())], right);
+  }
+  }
+}
+
+/// The printed value of `source`, or its runtime error and line
+template <typename Run>
+static std::string run_to_string(std::string_view const source, Run run) {
+  Scanner scanner(source);
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+  try {
+    return run(*ast, scanner.lines()).to_string();
+  } catch (RuntimeError const &error) {
+    return fmt::format("{} [line {}]", error.what(), error.line());
+  }
+}
+
+TEST_CASE("Bytecode VM matches the evaluator", "[vm]") {
+  auto const evaluate = [](Ast const &ast, LineTable const &lines) {
+    return Evaluator(ast, lines).evaluate();
+  };
+  auto const run_vm = [](Ast const &ast, LineTable const &lines) {
+    return Vm().run(compile(ast, lines));
+  };
+
+  for (auto const *source :
+       {"1 + 2 * 3", "-(1 + 2) / 4 <= 0", "\"a\" + \"b\" == \"ab\"", "!nil != !0",
+        "0 / 0 == 0 / 0", "1 +\n\n\"a\"", "-\n\"a\"", "nil"}) {
+    INFO(source);
+    REQUIRE(run_to_string(source, run_vm) == run_to_string(source, evaluate));
+  }
+
+  std::mt19937 gen(1234);
+  for (std::size_t i = 0; i < 500; ++i) {
+    auto const source = random_expression(gen, 6);
+    INFO(source);
+    REQUIRE(run_to_string(source, run_vm) == run_to_string(source, evaluate));
+  }
+}
+
+TEST_CASE("Bytecode chunks", "[vm]") {
+  Scanner scanner("1 + 2\n* -1 != \"a\"");
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+  auto const chunk = compile(*ast, scanner.lines());
+
+  // equal constants share a slot
+  REQUIRE(chunk.constants().size() == 3);
+  REQUIRE(chunk.max_stack() == 3);
+  REQUIRE(disassemble(chunk) == R"(0000    1 CONSTANT            0 '1'
+0002    | CONSTANT            1 '2'
+0004    2 CONSTANT            0 '1'
+0006    | NEGATE
+0007    | MULTIPLY
+0008    1 ADD
+0009    2 CONSTANT            2 "a"
+0011    | NOT_EQUAL
+0012    | RETURN
+)");
+
+  // past 256 constants, they need a wider index
+  std::string source = "0";
+  for (std::size_t i = 1; i < 1000; ++i) {
+    source.append(fmt::format(" + {}", i));
+  }
+  Scanner long_scanner(source);
+  Parser long_parser(long_scanner);
+  auto const long_ast = long_parser.parse();
+  REQUIRE(long_ast);
+  auto const long_chunk = compile(*long_ast, long_scanner.lines());
+  REQUIRE(long_chunk.constants().size() == 1000);
+  REQUIRE(Vm().run(long_chunk).as_number() == 499500.0);
+  REQUIRE(disassemble(long_chunk).find("CONSTANT_LONG     999 '999'") != std::string::npos);
+}
+
+/// A random expression in the numeric subset of the JIT
+static std::string
+random_numeric_expression(std::mt19937 &gen, std::size_t depth) {
+  auto const pick = [&gen](std::size_t const count) {
+    return std::uniform_int_distribution<std::size_t>(0, count - 1)(gen);
+  };
+  if (depth == 0 || pick(5) == 0) {
+    static constexpr std::array<std::string_view, 8> literals{
+        "0", "1", "2.5", "3", "0.1", "7", "1000000000000", "123.456"};
+    return std::string(literals[pick(literals.size())]);
+  }
+  static constexpr std::array<std::string_view, 4> operators{"+", "-", "*", "/"};
+  if (pick(4) == 0) {
+    return fmt::format("-({})", random_numeric_expression(gen, depth - 1));
+  }
+  auto const left = random_numeric_expression(gen, depth - 1);
+  auto const right = random_numeric_expression(gen, depth - 1);
+  return fmt::format("({} {} {})", left, operators[pick(operators.size())], right);
+}
+
+TEST_CASE("JIT matches the interpreter", "[jit]") {
+  auto const evaluate = [](Ast const &ast, LineTable const &lines) {
+    return Evaluator(ast, lines).evaluate();
+  };
+  auto const run_jit = [](Ast const &ast, LineTable const & /*lines*/) {
+    auto function = JitFunction::compile(ast);
+    REQUIRE(function);
+    return function->run();
+  };
+
+  if (!JitFunction::supported()) {
+    Scanner scanner("1 + 2");
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    REQUIRE(ast);
+    REQUIRE(!JitFunction::compile(*ast));
+    return;
+  }
+
+  std::vector<std::string> sources{
+      "1 + 2 * 3", "-(1 + 2) / 4", "1 / 0", "-1 / 0", "0 / 0", "-(0 / 0)",
+      "-0", "0.1 + 0.2", "1 < 2", "2 < 1", "1 <= 1", "2 > 1", "1 >= 2",
+      "1 == 1", "1 != 1", "0 / 0 == 0 / 0", "0 / 0 != 0 / 0", "0 / 0 < 1",
+      "0 / 0 > 1", "0 / 0 >= 0 / 0", "-0 == 0", "42"};
+  // deep enough to spill past the registers
+  std::string nested = "1";
+  for (std::size_t i = 2; i <= 40; ++i) {
+    nested = fmt::format("{} {} ({})", i, i % 2 == 0 ? "-" : "/", nested);
+  }
+  sources.push_back(nested);
+  sources.push_back(fmt::format("{} < {}", nested, nested + " + 1"));
+
+  std::mt19937 gen(4321);
+  for (std::size_t i = 0; i < 500; ++i) {
+    sources.push_back(random_numeric_expression(gen, 8));
+  }
+  for (std::size_t i = 0; i < 100; ++i) {
+    static constexpr std::array<std::string_view, 6> comparisons{
+        "<", "<=", ">", ">=", "==", "!="};
+    sources.push_back(fmt::format(
+        "{} {} {}",
+        random_numeric_expression(gen, 4),
+        comparisons[i % comparisons.size()],
+        random_numeric_expression(gen, 4)));
+  }
+
+  for (auto const &source : sources) {
+    INFO(source);
+    REQUIRE(run_to_string(source, run_jit) == run_to_string(source, evaluate));
+  }
+}
+
+TEST_CASE("JIT falls back on non-numeric expressions", "[jit]") {
+  for (auto const *source :
+       {"nil", "1 + nil", "(1 < 2) + 1", "!1", "\"a\" + \"b\"", "-true",
+        "1 < 2 == true", "(1 < 2) == (2 < 3)", "-(1 < 2)"}) {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    REQUIRE(ast);
+    INFO(source);
+    REQUIRE(!JitFunction::compile(*ast));
+  }
+
+  // whatever the JIT takes from random expressions, it must get right
+  std::mt19937 gen(1234);
+  for (std::size_t i = 0; i < 500; ++i) {
+    auto const source = random_expression(gen, 6);
+    Scanner scanner(source);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    REQUIRE(ast);
+    if (auto function = JitFunction::compile(*ast)) {
+      INFO(source);
+      REQUIRE(
+          function->run().to_string()
+          == Evaluator(*ast, scanner.lines()).evaluate().to_string());
+    }
+  }
+}
+
+/// The nodes of `ast` and the values of its numbers, to compare ASTs exactly
+static std::vector<std::string> node_dump(Ast const &ast) {
+  std::vector<std::string> dump;
+  for (auto const &node : ast.nodes()) {
+    dump.push_back(fmt::format(
+        "{} {} {} {} {}",
+        static_cast<int>(node.kind),
+        static_cast<int>(node.oper),
+        node.groups,
+        node.offset,
+        node.operand));
+    if (node.kind == NodeKind::NUMBER) {
+      dump.back().append(fmt::format(" {}", ast.number(node)));
+    }
+  }
+  return dump;
+}
+
+TEST_CASE("Incremental edits match scanning and parsing again", "[document]") {
+  static constexpr std::array<std::string_view, 16> insertions = {
+      "", "1", "23", ".", "+", "*", "-", "(", ")", "\"", " ", "\n", "/",
+      "x", "// c\n", "@"};
+  std::mt19937 gen(1234);
+  auto const pick = [&gen](std::size_t const count) {
+    return std::uniform_int_distribution<std::size_t>(0, count - 1)(gen);
+  };
+
+  std::size_t num_partial = 0;
+  for (std::size_t round = 0; round < 20; ++round) {
+    Document document(random_expression(gen, 6));
+    for (std::size_t step = 0; step < 50; ++step) {
+      auto const source = document.source();
+      auto offset = pick(source.size() + 1);
+      auto removed = std::min(pick(4), source.size() - offset);
+      auto inserted = insertions[pick(insertions.size())];
+      // most edits replace a number, which keeps the expression valid
+      static constexpr std::string_view number_chars = "0123456789.";
+      auto number = source.find_first_of(number_chars, offset);
+      if (number == std::string_view::npos) {
+        number = source.find_first_of(number_chars);
+      }
+      if (pick(16) != 0 && number != std::string_view::npos) {
+        static constexpr std::array<std::string_view, 4> numbers = {
+            "5", "67", "8.5", "9 * (3 + 4)"};
+        while (number > 0 && number_chars.find(source[number - 1])
+                                 != std::string_view::npos) {
+          --number;
+        }
+        auto const end = source.find_first_not_of(number_chars, number);
+        offset = number;
+        removed = std::min(end, source.size()) - number;
+        inserted = numbers[pick(numbers.size())];
+      }
+      auto const stats = document.edit(
+          {static_cast<std::uint32_t>(offset),
+           static_cast<std::uint32_t>(removed),
+           inserted});
+      num_partial += stats.full_parse ? 0U : 1U;
+
+      std::string const edited(document.source());
+      INFO(edited);
+      std::vector<std::string> tokens;
+      LineTable lines;
+      static_cast<void>(capture_stderr([&] {
+        Scanner scanner(edited);
+        auto const buffer = scanner.scan_tokens();
+        tokens = token_dump(buffer);
+        lines = buffer.lines();
+      }));
+      REQUIRE(token_dump(document.tokens()) == tokens);
+      REQUIRE(document.lines() == lines);
+
+      std::optional<Ast> ast;
+      std::size_t num_syntax_errors = 0;
+      auto const errors = capture_stderr([&] {
+        Scanner scanner(edited);
+        Parser parser(scanner);
+        ast = parser.parse();
+        num_syntax_errors = parser.errors().size();
+      });
+      DiagnosticSink diagnostics(document.source());
+      document.report(diagnostics);
+      fmt::memory_buffer document_errors;
+      diagnostics.format(document_errors, DiagnosticFormat::TEXT);
+      REQUIRE(fmt::to_string(document_errors) == errors);
+      REQUIRE(document.syntax_errors().size() == num_syntax_errors);
+      REQUIRE(document.ast().has_value() == ast.has_value());
+      if (ast) {
+        REQUIRE(node_dump(*document.ast()) == node_dump(*ast));
+      }
+    }
+  }
+  // the edits that keep the expression valid are parsed in their parentheses
+  REQUIRE(num_partial > 100);
+}
+
+TEST_CASE("Editing a document doesn't grow its tokens", "[document]") {
+  std::string source = "0";
+  for (std::size_t idx = 1; idx < 100; ++idx) {
+    source += fmt::format(" + ({} * {}.5)", idx, idx);
+  }
+  Document document(std::move(source));
+  auto const memory_usage = document.tokens().memory_usage();
+  for (std::size_t edit = 0; edit < 10000; ++edit) {
+    auto const offset = document.source().find('(') + 1;
+    document.edit(
+        {static_cast<std::uint32_t>(offset),
+         1,
+         edit % 2 == 0 ? std::string_view("7") : std::string_view("1")});
+    REQUIRE(document.ast());
+  }
+  REQUIRE(document.source().starts_with("0 + (1 * 1.5)"));
+  REQUIRE(document.tokens().memory_usage() <= 2 * memory_usage);
+  REQUIRE(
+      token_dump(document.tokens())
+      == token_dump(Scanner(document.source()).scan_tokens()));
+}
+
+TEST_CASE("Parsed scripts are cached", "[ast_cache]") {
+  TempDirectory const root("cache");
+  AstCache const cache(root.path());
+  std::mt19937 gen(42);
+  std::unordered_set<std::string> sources;
+  for (std::size_t idx = 0; idx < 20; ++idx) {
+    auto const source = random_expression(gen, 6);
+    INFO(source);
+    Scanner scanner(source);
+    Parser parser(scanner);
+    auto const ast = parser.parse();
+    REQUIRE(ast);
+    auto const key = AstCache::key(source);
+    // some expressions come up again
+    REQUIRE(cache.load(key).has_value() == !sources.insert(source).second);
+    cache.store(key, {*ast, scanner.lines()});
+    auto const script = cache.load(key);
+    REQUIRE(script);
+    REQUIRE(node_dump(script->ast) == node_dump(*ast));
+    REQUIRE(script->lines == scanner.lines());
+  }
+
+  // every corrupt byte and every truncation is detected
+  std::string_view const source = "(\"cached\" +\n\"string\") == nil";
+  Scanner scanner(source);
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+  auto const key = AstCache::key(source);
+  cache.store(key, {*ast, scanner.lines()});
+  REQUIRE_FALSE(cache.load(AstCache::key("(\"cached\" +\n\"strinG\") == nil")));
+  std::string entry;
+  {
+    SourceFile const file(cache.path(key).c_str());
+    entry = file.contents();
+  }
+  auto const rewrite = [&](std::string_view const bytes) {
+    std::ofstream(cache.path(key), std::ios::binary) << bytes;
+  };
+  for (std::size_t offset = 0; offset < entry.size(); ++offset) {
+    INFO(offset);
+    auto corrupt = entry;
+    corrupt[offset] = static_cast<char>(corrupt[offset] ^ 0x10);
+    rewrite(corrupt);
+    REQUIRE_FALSE(cache.load(key));
+    rewrite(std::string_view(entry).substr(0, offset));
+    REQUIRE_FALSE(cache.load(key));
+  }
+  rewrite(entry);
+  auto const script = cache.load(key);
+  REQUIRE(script);
+  REQUIRE(node_dump(script->ast) == node_dump(*ast));
+
+  // the interpreter runs scripts from the cache, and reports runtime errors
+  // at the same lines
+  auto const path = root / "runtime_error.lox";
+  std::ofstream(path) << "1 +\n-\"a\"\n";
+  auto const invalid = root / "syntax_error.lox";
+  std::ofstream(invalid) << "1 +";
+  LoxOptions options;
+  options.cache_directory = (root / "scripts").native();
+  for (std::size_t run = 0; run < 2; ++run) {
+    Lox lox(options);
+    int status = 0;
+    auto const errors =
+        capture_stderr([&] { status = lox.run_file(path.c_str()); });
+    REQUIRE(status == EX_SOFTWARE);
+    REQUIRE(errors == "Operand must be a number.\n[line 2]\n");
+    static_cast<void>(
+        capture_stderr([&] { status = lox.run_file(invalid.c_str()); }));
+    REQUIRE(status == EX_DATAERR);
+  }
+  // only the valid script was cached
+  REQUIRE(
+      std::distance(
+          std::filesystem::directory_iterator(options.cache_directory),
+          std::filesystem::directory_iterator())
+      == 1);
+
+  // entries that pass the checksum but aren't well-formed trees are rejected,
+  // and the script is parsed again
+  auto const negate = root / "negate.lox";
+  std::ofstream(negate) << "-nil";
+  auto const negate_key = AstCache::key("-nil");
+  AstCache const scripts(options.cache_directory);
+  auto const node = [](
+                        NodeKind const kind,
+                        TokenType const oper,
+                        std::uint32_t const operand = 0) {
+    return Node{kind, oper, 0, 0, operand};
+  };
+  auto const yes = node(NodeKind::BOOL, TokenType::TRUE, 1);
+  std::vector<std::vector<Node>> const malformed{
+      // too many operands on the stack, then too few
+      {yes, yes, node(NodeKind::BINARY, TokenType::EQUAL_EQUAL, 0),
+       node(NodeKind::BINARY, TokenType::MINUS, 0)},
+      {yes, yes},
+      {node(NodeKind::UNARY, TokenType::MINUS), yes},
+      // the left operand isn't the root of the subtree before the right one
+      {yes, yes, node(NodeKind::UNARY, TokenType::BANG),
+       node(NodeKind::BINARY, TokenType::EQUAL_EQUAL, 1)},
+      // operators of the wrong kind
+      {yes, yes, node(NodeKind::BINARY, TokenType::BANG, 0)},
+      {yes, node(NodeKind::UNARY, TokenType::PLUS)},
+      {node(NodeKind::BOOL, TokenType::TRUE, 0)},
+      {node(NodeKind::NIL, TokenType::STRING)},
+  };
+  for (auto const &nodes : malformed) {
+    scripts.store(negate_key, {Ast(nodes, {1.0}), LineTable({0})});
+    REQUIRE_FALSE(scripts.load(negate_key));
+    Lox lox(options);
+    int status = 0;
+    auto const errors =
+        capture_stderr([&] { status = lox.run_file(negate.c_str()); });
+    REQUIRE(status == EX_SOFTWARE);
+    REQUIRE(errors == "Operand must be a number.\n[line 1]\n");
+    REQUIRE(scripts.load(negate_key));
+  }
+
+  // an entry that can't be put in place leaves nothing behind
+  auto const blocked_key = AstCache::key("1");
+  std::filesystem::create_directories(scripts.path(blocked_key) / "in_the_way");
+  auto const num_files = std::distance(
+      std::filesystem::directory_iterator(options.cache_directory),
+      std::filesystem::directory_iterator());
+  REQUIRE_THROWS_AS(
+      scripts.store(blocked_key, {Ast(), LineTable()}), std::system_error);
+  REQUIRE(
+      std::distance(
+          std::filesystem::directory_iterator(options.cache_directory),
+          std::filesystem::directory_iterator())
+      == num_files);
+}
+
+TEST_CASE("Run statistics", "[stats]") {
+  std::string_view const source = "(1 + 2) *\n-3";
+  Scanner scanner(source);
+  auto const tokens = scanner.scan_tokens();
+  Parser parser(
+      tokens, 0, tokens.size() - 1, tokens.lines(), scanner.diagnostics());
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+  RunStats stats;
+  stats.source_bytes = source.size();
+  stats.count_tokens(tokens);
+  stats.count_nodes(*ast);
+  fmt::memory_buffer json;
+  stats.format(json, StatsFormat::JSON);
+  REQUIRE(
+      fmt::to_string(json)
+      == R"({"seconds":{"load":0.000000,"cache":0.000000,"scan":0.000000,)"
+         R"("parse":0.000000,"run":0.000000,"total":0.000000},)"
+         R"("source_bytes":12,"tokens":9,"tokens_by_type":{"LEFT_PAREN":1,)"
+         R"("RIGHT_PAREN":1,"MINUS":1,"PLUS":1,"STAR":1,"NUMBER":3,)"
+         R"("END_OF_FILE":1},"nodes":6,"nodes_by_kind":{"BINARY":2,)"
+         R"("UNARY":1,"NUMBER":3},"max_depth":3})"
+         "\n");
+
+  fmt::memory_buffer table;
+  stats.format(table, StatsFormat::TABLE);
+  auto const text = fmt::to_string(table);
+  REQUIRE_THAT(text, Catch::Matchers::StartsWith("phase"));
+  REQUIRE(text.find("\n  NUMBER") != std::string::npos);
+  REQUIRE_THAT(text, Catch::Matchers::EndsWith("max depth"
+                                               "                      3\n"));
+
+  // the scanner and the parser run apart, but find the same errors and lines
+  TempDirectory const root("stats");
+  auto const path = root / "runtime_error.lox";
+  std::ofstream(path) << "1 +\n-\"a\"\n";
+  auto const invalid = root / "syntax_error.lox";
+  std::ofstream(invalid) << "1 +\n* 2 @";
+  LoxOptions options;
+  options.stats = StatsFormat::JSON;
+  for (auto const &cache : {std::string(), (root / "cache").native()}) {
+    options.cache_directory = cache;
+    // the second time from the cache
+    for (std::size_t run = 0; run < 2; ++run) {
+      Lox lox(options);
+      int status = 0;
+      auto const errors =
+          capture_stderr([&] { status = lox.run_file(path.c_str()); });
+      REQUIRE(status == EX_SOFTWARE);
+      REQUIRE_THAT(
+          errors,
+          Catch::Matchers::StartsWith(
+              "Operand must be a number.\n[line 2]\n{\"seconds\":{"));
+      REQUIRE_THAT(
+          errors,
+          Catch::Matchers::EndsWith(
+              R"("nodes":4,"nodes_by_kind":{"BINARY":1,"UNARY":1,"NUMBER":1,)"
+              R"("STRING":1},"max_depth":3})"
+              "\n"));
+    }
+  }
+  Lox lox(options);
+  int status = 0;
+  auto const errors =
+      capture_stderr([&] { status = lox.run_file(invalid.c_str()); });
+  REQUIRE(status == EX_DATAERR);
+  REQUIRE_THAT(
+      errors,
+      Catch::Matchers::StartsWith(
+          "Error at line: 2: Unexpected character: @\n"
+          "Error at line: 2: Expected expression:  at \"*\"\n"
+          R"({"seconds":{"load":)"));
+}
+
+TEST_CASE("Chrome trace of a run", "[tracer]") {
+  TempDirectory const root("trace");
+  auto const script = root / "script.lox";
+  // a runtime error, so that nothing is printed
+  std::ofstream(script) << "(1 + 2) * -\"a\"";
+  auto const invalid = root / "invalid.lox";
+  std::ofstream(invalid) << "1 +";
+  auto const trace = root / "trace.json";
+  auto const read_trace = [&trace] {
+    SourceFile const file(trace.c_str());
+    return std::string(file.contents());
+  };
+
+  auto &tracer = Tracer::global();
+  tracer.start();
+  LoxOptions options;
+  options.jobs = 2;
+  Lox lox(options);
+  auto const run_script = [&lox, &script] {
+    int status = 0;
+    static_cast<void>(
+        capture_stderr([&] { status = lox.run_file(script.c_str()); }));
+    return status;
+  };
+  REQUIRE(run_script() == EX_SOFTWARE);
+  std::array<char const *, 2> const paths{script.c_str(), invalid.c_str()};
+  static_cast<void>(capture_stderr([&] { lox.check_files(paths); }));
+  tracer.write(trace.c_str());
+  tracer.stop();
+
+  auto const events = read_trace();
+  REQUIRE_THAT(events, Catch::Matchers::StartsWith(R"({"traceEvents":[)"));
+  REQUIRE_THAT(
+      events,
+      Catch::Matchers::EndsWith(
+          R"(],"displayTimeUnit":"ms","otherData":{"dropped_events":0}})"
+          "\n"));
+  for (auto const *const span :
+       {R"("args":{"name":"main"})",
+        R"("args":{"name":"worker 1"})",
+        R"({"name":"run_file","ph":"X")",
+        R"({"name":"load","ph":"X")",
+        R"({"name":"scan","ph":"X")",
+        R"({"name":"parse","ph":"X")",
+        R"({"name":"expression","ph":"X")",
+        R"({"name":"compile","ph":"X")",
+        R"({"name":"evaluate","ph":"X")",
+        R"({"name":"check","ph":"X")",
+        R"({"name":"scan and parse","ph":"X")"}) {
+    INFO(span);
+    REQUIRE(events.find(span) != std::string::npos);
+  }
+  REQUIRE(
+      events.find(fmt::format(R"("args":{{"detail":"{}"}})", invalid.native()))
+      != std::string::npos);
+
+  // nothing is recorded once stopped
+  REQUIRE(run_script() == EX_SOFTWARE);
+  tracer.write(trace.c_str());
+  REQUIRE(read_trace().find(R"("ph":"X")") == std::string::npos);
+
+  // a thread that records too many spans keeps the last ones
+  tracer.start();
+  std::thread([] {
+    for (std::size_t idx = 0; idx < Tracer::events_per_thread + 10; ++idx) {
+      TraceSpan const span("span");
+    }
+  }).join();
+  tracer.write(trace.c_str());
+  tracer.stop();
+  REQUIRE_THAT(
+      read_trace(),
+      Catch::Matchers::EndsWith(R"("dropped_events":10}})"
+                                "\n"));
+
+  // and the details of the last spans, once they take up all their room
+  tracer.start();
+  auto const detail = [](std::size_t const idx) {
+    return fmt::format("{:05}{}", idx, std::string(1000, 'x'));
+  };
+  auto const num_spans = Tracer::detail_bytes_per_thread / 1000;
+  std::thread([&] {
+    for (std::size_t idx = 0; idx < num_spans; ++idx) {
+      auto const text = detail(idx);
+      TraceSpan const span("span", text);
+    }
+  }).join();
+  tracer.write(trace.c_str());
+  tracer.stop();
+  auto const details = read_trace();
+  REQUIRE(details.find(detail(0)) == std::string::npos);
+  REQUIRE(details.find(detail(num_spans - 1)) != std::string::npos);
+  REQUIRE(
+      details.find(fmt::format(
+          R"("args":{{"detail":"{}"}})", detail(num_spans - 1000)))
+      != std::string::npos);
+}
+
+TEST_CASE("Keyword lookup", "[.][benchmark]") {
+  // identifier-heavy input: reserved words mixed with names that share their
+  // length and first letter
+  std::vector<std::string_view> const words = {
+      "and",   "ant",  "class", "clasp",  "else",  "elsa", "false", "fals",
+      "for",   "fun",  "fur",   "if",     "it",    "nil",  "nib",   "or",
+      "of",    "print", "paint", "return", "retire", "super", "suppr",
+      "this",  "that", "true",  "tree",   "var",   "val",  "while", "whale",
+      "x",     "count", "index", "value",  "result", "i",    "j"};
+  std::string source;
+  for (std::size_t i = 0; i < 10'000; ++i) {
+    source.append(words[i % words.size()]).append(" ");
+  }
+
+  BENCHMARK("perfect hash") {
+    std::size_t sum = 0;
+    for (auto const word : words) {
+      sum += static_cast<std::size_t>(keyword_type(word));
+    }
+    return sum;
+  };
+
+  BENCHMARK("std::unordered_map") {
+    static const std::unordered_map<std::string_view, TokenType> reserved_words(
+        {{"and", TokenType::AND},
+         {"class", TokenType::CLASS},
+         {"else", TokenType::ELSE},
+         {"false", TokenType::FALSE},
+         {"for", TokenType::FOR},
+         {"fun", TokenType::FUN},
+         {"if", TokenType::IF},
+         {"nil", TokenType::NIL},
+         {"or", TokenType::OR},
+         {"print", TokenType::PRINT},
+         {"return", TokenType::RETURN},
+         {"super", TokenType::SUPER},
+         {"this", TokenType::THIS},
+         {"true", TokenType::TRUE},
+         {"var", TokenType::VAR},
+         {"while", TokenType::WHILE}});
+    std::size_t sum = 0;
+    for (auto const word : words) {
+      auto const it = reserved_words.find(word);
+      sum += static_cast<std::size_t>(
+          it == reserved_words.end() ? TokenType::IDENTIFIER : it->second);
+    }
+    return sum;
+  };
+
+  BENCHMARK("scan identifier-heavy source") {
+    Scanner scanner(source.c_str());
+    return scanner.scan_tokens().size();
+  };
+}
+
+TEST_CASE("Skipping comments and whitespace", "[.][benchmark]") {
+  std::string source;
+  for (std::size_t i = 0; i < 10'000; ++i) {
+    source
+        .append("        // a fairly long comment explaining the next line\n")
+        .append("        value = \"a string literal of some length\";\n");
+  }
+
+  for (auto const level : supported_simd_levels()) {
+    use_simd_level(level);
+    BENCHMARK(fmt::format("scan at SIMD level {}", static_cast<int>(level))) {
+      Scanner scanner(source.c_str());
+      return scanner.scan_tokens().size();
+    };
+  }
+  use_simd_level(best_simd_level());
+}
+
+TEST_CASE("Scanning a random mix of tokens", "[.][benchmark]") {
+  static constexpr std::array<std::string_view, 27> tokens = {
+      "(",  ")",  "{",    "}",     ",",   ".",  "-",     "+",  ";",
+      "*",  "/",  "!",    "!=",    "=",   "==", "<",     "<=", ">",
+      ">=", "foo", "x1", "while", "and", "12", "3.5", "\"str\"", "\n"};
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<std::size_t> pick(0, tokens.size() - 1);
+  std::string source;
+  for (std::size_t i = 0; i < 100'000; ++i) {
+    source.append(tokens[pick(gen)]).append(" ");
+  }
+
+  BENCHMARK("scan") {
+    Scanner scanner(source.c_str());
+    return scanner.scan_tokens().size();
+  };
+}
+
+TEST_CASE("Scanning in parallel", "[.][benchmark]") {
+  std::string source;
+  for (std::size_t i = 0; i < 200'000; ++i) {
+    source.append("  var x = \"some text\" + foo(12.5, bar) != nil; // note\n");
+  }
+
+  auto const max_threads = std::max(1U, std::thread::hardware_concurrency());
+  BENCHMARK("sequential") {
+    Scanner scanner(source);
+    return scanner.scan_tokens().size();
+  };
+  for (std::size_t num_threads = 1; num_threads <= max_threads;
+       num_threads *= 2) {
+    ThreadPool pool(num_threads);
+    BENCHMARK(fmt::format("{} threads", num_threads)) {
+      ParallelScanner scanner(source, pool);
+      return scanner.scan_tokens().size();
+    };
+  }
+}
+
+TEST_CASE("Parsing chained binary expressions", "[.][benchmark]") {
+  // long runs of operators of every precedence level, nested a few levels deep
+  static constexpr std::array<std::string_view, 10> operators = {
+      " + ", " - ", " * ", " / ", " < ", " <= ", " > ", " >= ", " == ", " != "};
+  std::string chain = "1";
+  for (std::size_t i = 0; i < 1'000; ++i) {
+    chain.append(operators[i % operators.size()]).append(std::to_string(i));
+  }
+  std::string source = chain;
+  for (std::size_t i = 0; i < 20; ++i) {
+    source = fmt::format("-({}) * !({})", chain, source);
+  }
+
+  BENCHMARK("parse") {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    return parser.parse()->size();
+  };
+}
+
+TEST_CASE("Evaluating arithmetic expressions", "[.][benchmark]") {
+  // chains of 64 operands, so that evaluation doesn't recurse too deep
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> digit(1, 9);
+  std::uniform_int_distribution<std::size_t> oper(0, 3);
+  static constexpr std::array<char const *, 4> operators{" + ", " - ", " * ", " / "};
+  std::string source = "0";
+  for (std::size_t i = 0; i < 64; ++i) {
+    source.append(operators[oper(gen)]).push_back(static_cast<char>('0' + digit(gen)));
+  }
+  Scanner scanner(source);
+  Parser parser(scanner);
+  auto const ast = parser.parse();
+  REQUIRE(ast);
+
+  BENCHMARK("tree-walking evaluator") {
+    return Evaluator(*ast, scanner.lines()).evaluate();
+  };
+
+  auto const chunk = compile(*ast, scanner.lines());
+  Vm vm;
+  BENCHMARK("bytecode VM") {
+    return vm.run(chunk);
+  };
+
+  if (auto function = JitFunction::compile(*ast)) {
+    BENCHMARK("JIT") {
+      return function->run();
+    };
+  }
+}
+
+TEST_CASE("Parsing malformed inputs", "[.][benchmark]") {
+  // many small files with a few errors each, like generated code gone wrong
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> digit(0, 9);
+  std::vector<std::string> sources;
+  for (std::size_t file = 0; file < 1000; ++file) {
+    std::string source;
+    for (std::size_t statement = 0; statement < 4; ++statement) {
+      for (std::size_t operand = 0; operand < 16; ++operand) {
+        source.push_back(static_cast<char>('0' + digit(gen)));
+        source.append(operand == 8 ? " * + " : " + ");
+      }
+      source.append("1;\n");
+    }
+    sources.push_back(std::move(source));
+  }
+
+  // the errors are reported on stderr, which is muted meanwhile
+  std::fflush(stderr);
+  auto const saved_fd = dup(fileno(stderr));
+  auto *const null = std::fopen("/dev/null", "w");
+  dup2(fileno(null), fileno(stderr));
+
+  BENCHMARK("files with syntax errors") {
+    std::size_t num_errors = 0;
+    for (auto const &source : sources) {
+      Scanner scanner(source);
+      Parser parser(scanner);
+      static_cast<void>(parser.parse());
+      num_errors += parser.errors().size();
+    }
+    return num_errors;
+  };
+
+  std::fflush(stderr);
+  dup2(saved_fd, fileno(stderr));
+  close(saved_fd);
+  std::fclose(null);
+}
+
+TEST_CASE("Editing a large file", "[.][benchmark]") {
+  // a long sum of parenthesized terms, edited inside one of them
+  std::mt19937 gen(42);
+  std::string source;
+  for (std::size_t term = 0; term < 20'000; ++term) {
+    source.append(term == 0 ? "" : " +\n").append(random_expression(gen, 4));
+  }
+  // before a number, where inserting a digit keeps the source valid
+  auto offset = static_cast<std::uint32_t>(source.size() / 2);
+  while (source[offset - 1] != '(' || source[offset] < '0'
+         || source[offset] > '9') {
+    ++offset;
+  }
+
+  Document document(source);
+  BENCHMARK("incremental edit") {
+    // insert a digit then remove it, to keep the document the same
+    document.edit({offset, 0, "1"});
+    return document.edit({offset, 1, ""}).nodes_parsed;
+  };
+
+  BENCHMARK("scanning and parsing again") {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    return parser.parse()->size();
+  };
+}
+
+TEST_CASE("Checking many files", "[.][benchmark]") {
+  TempDirectory const root("check_bench");
+  std::mt19937 gen(42);
+  for (std::size_t idx = 0; idx < 10'000; ++idx) {
+    std::ofstream(root / fmt::format("{:05}.lox", idx))
+        << random_expression(gen, 8);
+  }
+  auto const path = root.path().native();
+  std::array<char const *, 1> const args{path.c_str()};
+
+  std::vector<std::size_t> thread_counts{1};
+  if (std::thread::hardware_concurrency() > 1) {
+    thread_counts.push_back(std::thread::hardware_concurrency());
+  }
+  for (auto const jobs : thread_counts) {
+    LoxOptions options;
+    options.jobs = jobs;
+    Lox lox(options);
+    BENCHMARK(fmt::format("10000 files on {} threads", jobs)) {
+      return lox.check_files(args);
+    };
+  }
+}
+
+TEST_CASE("Starting from the cache", "[.][benchmark]") {
+  std::mt19937 gen(42);
+  std::string source;
+  for (std::size_t term = 0; term < 20'000; ++term) {
+    source.append(term == 0 ? "" : " +\n").append(random_expression(gen, 4));
+  }
+  TempDirectory const root("cache_bench");
+  AstCache const cache(root.path());
+  auto const parse = [&source] {
+    Scanner scanner(source);
+    Parser parser(scanner);
+    auto ast = parser.parse();
+    return ParsedScript{std::move(*ast), scanner.lines()};
+  };
+
+  BENCHMARK("scanning and parsing") {
+    return parse().ast.size();
+  };
+
+  BENCHMARK("cold cache") {
+    std::filesystem::remove_all(root.path());
+    auto const key = AstCache::key(source);
+    if (auto script = cache.load(key)) {
+      return script->ast.size();
+    }
+    auto const script = parse();
+    cache.store(key, script);
+    return script.ast.size();
+  };
 
-  Parser parser(tokens);
-  auto expr = parser.parse();
-  fmt::println("{}", expr->to_string());
-  REQUIRE(expr);
-  REQUIRE(expr->to_string() == R"dst((== (! (! (group (* (* (- 123) (group 45.67)) "asd")))) (group (!= "abc" 42.42))))dst");
-  std::ranges::for_each(tokens, std::mem_fn(&Token::free_token));
+  BENCHMARK("warm cache") {
+    return cache.load(AstCache::key(source))->ast.size();
+  };
 }